@@ -47,12 +47,34 @@
    attach(pin )  - Attaches a servo motor to an i/o pin.
    attach(pin, min, max  ) - Attaches to a pin setting min and max values in microseconds
    default min is 544, max is 2400
+   attachEsc(pin, protocol) - Attaches an ESC using ESC_PWM, ESC_ONESHOT125, ESC_ONESHOT42, ESC_DSHOT150 or ESC_DSHOT300 at minimum throttle
+   escCalibrate(ms) - Sends full throttle for ms milliseconds, then minimum throttle
+   attachPpm(pin) - Sends this servo as the next channel of a PPM stream on pin instead of pulsing a pin of its own
+
+   setFilter(filter) - smooth written pulse widths at every frame, FILTER_EMA(shift), FILTER_MEDIAN or FILTER_NONE, with VARSPEEDSERVO_FILTERS
+   setReverse(reversed) - reverse the direction of angles written to this servo, with VARSPEEDSERVO_CURVES
+   setTrim(microseconds) - shift the center of angles written to this servo by the given pulse width, with VARSPEEDSERVO_CURVES
+   setExpo(percent) - soften angles near the center with an exponential curve, 0 (default) to 100%, with VARSPEEDSERVO_CURVES
+   VarSpeedServo::beginCapture(mode) - decode an RC receiver on the Timer1 input capture pin, CAPTURE_PWM or CAPTURE_PPM
+   VarSpeedServo::readInput(channel) - last pulse width in microseconds received on an input channel, 0 if none yet
+   VarSpeedServo::inputLatency() - microseconds from the end of the last routed input pulse to the start of the servo pulse
+   follow(channel) - route an input channel to this servo at the next frame, NO_INPUT to stop
+   mix(inputA,weightA,inputB,weightB) - set this servo from a weighted sum of two input channels at every frame, MIX_UNITY is 100%, with VARSPEEDSERVO_MIX
+   followAnalog(pin,deadband) - set this servo from an analog pin sampled once per frame by the ADC interrupt, NO_INPUT to stop
+   VarSpeedServo::beginSerialInput(protocol) - receive SERIAL_SBUS or SERIAL_IBUS in the UART interrupt into the input channels
+   VarSpeedServo::serialInput(byte) - feed one received SBUS/iBUS byte to the decoder, when the UART is read elsewhere
 
    write(value)     - Sets the servo angle in degrees.  (invalid angle that is valid as pulse in microseconds is treated as microseconds)
    write(value, speed) - speed varies the speed of the move to new position 0=full speed, 1-255 slower to faster
    write(value, speed, wait) - wait is a boolean that, if true, causes the function call to block until move is complete
+   writeAtRate(value, degreesPerSecond) - as write(value, speed) with the speed given in degrees per second
+   writeMicrosecondsAtRate(value, microsecondsPerSecond) - as write(value, speed) with the speed given in microseconds per second
+   setAcceleration(degreesPerSecondSquared) - accelerate and decelerate moves, new targets keep the current velocity
+   setAccelerationMicroseconds(microsecondsPerSecondSquared) - as setAcceleration() in microseconds per second per second
 
    writeMicroseconds() - Sets the servo pulse width in microseconds
+   writeMicrosecondsFine(value, fraction) - Sets the pulse width in microseconds plus fraction/256 microseconds
+   setDither(on) - alternate the pulse between adjacent timer ticks to deliver the average of fractional widths
    read()      - Gets the last written servo pulse width as an angle between 0 and 180.
    readMicroseconds()  - Gets the last written servo pulse width in microseconds. (was read_us() in first release)
    attached()  - Returns true if there is a servo attached.
@@ -60,31 +82,123 @@
 
    slowmove(value, speed) - The same as write(value, speed), retained for compatibility with Korman's version
 
-   stop() - stops the servo at the current position
+   stop() - stops the servo at the current position, decelerating if an acceleration is set
+   stopAll() - emergency stop, halts every servo within one refresh frame
+   snapshot(states, count) - copies position, target and moving flag of every servo as one consistent pose
+
+   VarSpeedServo(controller) - a servo of another ServoController than ServoEngine, pulsed by the owner of that engine
+   ServoController::handleInterrupt(timer, count, compare) - run an engine from a timer other than the servo timers
+   ServoController::edgeDelay() - worst delay in microseconds of a pulse edge since the last call
+   ServoController::service() - pulse the servos of an engine from loop() or a shared interrupt, without a timer
 
    sequencePlay(sequence, sequencePositions); // play a looping sequence starting at position 0
    sequencePlay(sequence, sequencePositions, loop, startPosition); // play sequence with number of positions, loop if true, start at position
    sequenceStop(); // stop sequence at current position
 
+   estimateMoveTime(value, speed); // milliseconds a write(value, speed) would take from the current position
+   moveTimeRemaining(); // milliseconds until the current move completes
+
  */
 
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <Arduino.h> // updated from WProgram.h to Arduino.h for Arduino 1.0+, pva
 
 #include "VarSpeedServo.h"
 
-#define usToTicks(_us)    (( clockCyclesPerMicrosecond()* _us) / 8)     // converts microseconds to tick (assumes prescale of 8)  // 12 Aug 2009
-#define ticksToUs(_ticks) (( (unsigned)_ticks * 8)/ clockCyclesPerMicrosecond() ) // converts from ticks back to microseconds
+#define usToTicks(_us)    (( clockCyclesPerMicrosecond()* (_us)) / 8)     // converts microseconds to tick (assumes prescale of 8)  // 12 Aug 2009
+#define ticksToUs(_ticks) (( (unsigned)(_ticks) * 8)/ clockCyclesPerMicrosecond() ) // converts from ticks back to microseconds
 
 
+// converts a rate in uS per second to a slowmove step in 1/256 ticks per refresh frame,
+// so the speed of a move doesn't depend on the refresh interval or the clock
+#define usPerSecondToStep(_rate, _interval) ((usToTicks((unsigned long)(_rate)) * (256UL * (_interval) / 1000)) / 1000)
+
 #define TRIM_DURATION       2                               // compensation ticks to trim adjust for digitalWrite delays // 12 August 2009
+#define PULSE_LIMIT         ((int)ticksToUs(0xFFFF / 8))       // longest pulse attach() accepts, ticksToUs() multiplies in 16 bits on AVR
 
 //#define NBR_TIMERS        (MAX_SERVOS / SERVOS_PER_TIMER)
 
-static servo_t servos[MAX_SERVOS];                          // static array of servo structures
-static volatile int8_t Channel[_Nbr_16timers ];             // counter for the servo being pulsed for each timer (or -1 if refresh interval)
+ServoController ServoEngine;                                // channel data and timer state of the servos pulsed by the timer interrupts
+
+// RC receiver input, the timers run freely so captured times can be subtracted
+#if defined(VARSPEEDSERVO_INPUT_CAPTURE) && defined(_useTimer1) && !defined(WIRING) && !defined(__AVR_ATmega8__) && !defined(__AVR_ATmega128__)
+#define _useCapture1
+#endif
+static volatile unsigned int InputTicks[MAX_INPUT_CHANNELS];  // last pulse width in ticks of each input channel, 0 if none
+static unsigned int InputStamp[MAX_INPUT_CHANNELS];         // INPUT_CLOCK() at which each input pulse ended
+static volatile uint16_t InputFresh;                        // bit per input channel with a value no servo has used yet
+static volatile unsigned int InputLatency;                  // ticks from the end of an input pulse to the servo pulse using it
+#if defined(_useCapture1)
+static uint8_t CaptureMode;                                 // CAPTURE_PWM, CAPTURE_PPM or 0
+static unsigned int CaptureLast;                            // Timer1 count of the previous captured edge
+static uint8_t CaptureChannel;                              // next PPM channel, MAX_INPUT_CHANNELS until a sync gap is seen
+#endif
+
+// serial receivers, channels are collected while a packet arrives and committed when it is complete
+#define SBUS_PACKET_SIZE       25     // header, 16 channels of 11 bits, flags and footer
+#define SBUS_HEADER          0x0F
+#define SBUS_FAILSAFE        0x08     // flag bit set by the receiver when the transmitter signal is lost
+#define SBUS_CHANNELS          16
+#define SBUS_GAP             3000     // uS without a byte that ends a packet, they are 7 or 14 mS apart
+#define IBUS_PACKET_SIZE       32     // length, command, 14 channels of 16 bits and checksum
+#define IBUS_CHANNELS          14
+static uint8_t SerialProtocol;                              // SERIAL_SBUS, SERIAL_IBUS or 0
+static uint8_t SerialIndex;                                 // position of the next byte in the packet
+static uint8_t SerialChannel;                               // next channel to decode from the packet
+static uint8_t SerialBits;                                  // number of SBUS bits in SerialBuffer
+static uint32_t SerialBuffer;                               // SBUS bits not yet decoded, iBUS low byte of a channel
+static unsigned int SerialChecksum;                         // iBUS checksum of the bytes so far
+static unsigned int SerialPending[SBUS_CHANNELS];           // channels of the packet being received, in ticks
+static unsigned long SerialTime;                            // micros() at the last SBUS byte
+
+// analog input followed by one servo, the ADC is started at the start of each frame of its timer
+#if defined(ADCSRA) && !defined(WIRING) && defined(VARSPEEDSERVO_ANALOG_INPUT)
+#define _useAnalog
+static ServoController *AnalogEngine;                       // engine of the servo following the ADC
+static uint8_t AnalogServo;                                 // servo index + 1 following the ADC, 0 if none
+static uint8_t AnalogTimer;                                 // timer16_Sequence_t of that servo
+static unsigned int AnalogMinTicks;                         // pulse range of that servo in ticks
+static unsigned int AnalogSpanTicks;
+static uint8_t AnalogDeadband;                              // change of the sample in ADC counts that is ignored
+static unsigned int AnalogLast;                             // sample the servo was last set from
+#endif
+
+// the time base for input timestamps and latency in ticks, from micros() as the timers may run at other
+// rates (Timer1 is in the PWM mode of the core with the Timer2 backend or before Timer1 is used on a Mega);
+// only the low 16 bits are kept, which stay exact when the product wraps as 2^32 is a multiple of 8
+#define INPUT_CLOCK() ((uint16_t)(clockCyclesPerMicrosecond() * micros() / 8))
+
+// Timer2 counts 8 bits at a quarter of the tick rate, its overflows extend the count to the 16 bits of the
+// other timers; the compare match repeats every 256 counts until the extended compare is reached
+#if defined(_useTimer2)
+#if defined(VARSPEEDSERVO_NESTED_INTERRUPTS)
+// the nested update times the end of the pulse from the count the handler is called with, a snapshot
+// of the extended Timer2 count that doesn't advance, so a late end would go unnoticed
+#error "VARSPEEDSERVO_NESTED_INTERRUPTS can't be used with VARSPEEDSERVO_TIMER2"
+#endif
+#define TIMER2_SHIFT            2     // ticks per Timer2 count as a shift, prescaler 32 instead of 8
+static volatile uint8_t Timer2High;                         // overflows of Timer2, the high bits of the extended count
+static volatile uint16_t Timer2Compare;                     // extended compare match in ticks
+static uint16_t Timer2CompareSet;                           // extended count at which it was set
+#endif
 
-uint8_t ServoCount = 0;                                     // the total number of attached servos
+// pulse range and refresh interval in uS and channels per timer for each escProtocol_t; the channels
+// of a timer are pulsed one after the other, so their longest pulses and the interrupt latency of
+// each edge must fit the interval together, DShot frames take 107 uS (DShot150) or 53 uS (DShot300)
+// of the interrupt handler each. The table is in flash, read with pgm_read_word()/pgm_read_byte()
+static const struct {
+  uint16_t min;
+  uint16_t max;
+  uint16_t refresh;
+  uint8_t channels;
+} EscProtocols[] PROGMEM = {
+  { 1000, 2000, 2500, 1 },                  // ESC_PWM, 2000 uS of pulses
+  {  125,  250,  500, 1 },                  // ESC_ONESHOT125, 250 uS of pulses
+  {   42,   84,  250, 2 },                  // ESC_ONESHOT42, 168 uS of pulses
+  { 1000, 2000, 1000, 8 },                  // ESC_DSHOT150, 853 uS of frames
+  { 1000, 2000,  500, 6 }                   // ESC_DSHOT300, 320 uS of frames
+};
 
 // sequence vars
 
@@ -98,87 +212,731 @@ servoSequencePoint initSeq[] = {{0,100},{45,100}};
 #define SERVO_INDEX(_timer,_channel)  ((_timer*SERVOS_PER_TIMER) + _channel)     // macro to access servo index by timer and channel
 #define SERVO(_timer,_channel)  (servos[SERVO_INDEX(_timer,_channel)])            // macro to access servo class by timer and channel
 
-#define SERVO_MIN() (MIN_PULSE_WIDTH - this->min * 4)  // minimum value in uS for this servo
-#define SERVO_MAX() (MAX_PULSE_WIDTH - this->max * 4)  // maximum value in uS for this servo
+#define SERVO_MIN() (this->min)  // minimum value in uS for this servo
+#define SERVO_MAX() (this->max)  // maximum value in uS for this servo
+#define NO_WRITE    (-32767 - 1) // lastWrite and lastMicroseconds when the next write has to be done
+#if defined(VARSPEEDSERVO_FILTERS)
+#define FILTER_OF(_servo) ((_servo)->filter)     // the filter of a servo, FILTER_NONE without VARSPEEDSERVO_FILTERS
+#else
+#define FILTER_OF(_servo) FILTER_NONE
+#endif
+
+// timer ticks from micros() for engines run by service(), the same clock as INPUT_CLOCK() for any F_CPU
+#define SERVICE_CLOCK() INPUT_CLOCK()
 
 /************ static functions common to all instances ***********************/
 
-static inline void handle_interrupts(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t* OCRnA)
+// returns the distance (in 1/256 ticks) covered while braking from velocity to a stop with accel per frame
+static inline unsigned long brakingDistance(long velocity, long accel)
 {
-  if( Channel[timer] < 0 )
-    *TCNTn = 0; // channel set to -1 indicated that refresh interval completed so reset the timer
-  else{
-    if( SERVO_INDEX(timer,Channel[timer]) < ServoCount && SERVO(timer,Channel[timer]).Pin.isActive == true )
-      digitalWrite( SERVO(timer,Channel[timer]).Pin.nbr,LOW); // pulse this channel low if activated
-  }
+  return (unsigned long)velocity * (velocity + accel) / (2 * accel);
+}
 
-  Channel[timer]++;    // increment to the next channel
-  if( SERVO_INDEX(timer,Channel[timer]) < ServoCount && Channel[timer] < SERVOS_PER_TIMER) {
+// DShot bit timing in CPU cycles: the bit period, the high time of a 1 and of a 0 (75% and 37.5% of the period)
+#define DSHOT_BIT_CYCLES(_kbits)  (F_CPU / 1000UL / (_kbits))
+#define DSHOT_T1H_CYCLES(_kbits)  (DSHOT_BIT_CYCLES(_kbits) * 3 / 4)
+#define DSHOT_T0H_CYCLES(_kbits)  (DSHOT_BIT_CYCLES(_kbits) * 3 / 8)
+
+// cycles of the bit loop of dshotSend outside its delays, counted from the AVR instruction set manual
+// for the classic megaAVR core (st 2, mov 1, sbrc + mov 2 either way, lsl 1, rol 1, dec 1, brne taken 2):
+// rising edge to the store ending a 0, to the store ending a 1, and to the next rising edge
+#define DSHOT_T0H_LOOP            5
+#define DSHOT_T1H_LOOP            7
+#define DSHOT_BIT_LOOP           14
+#define DSHOT_DELAY_CYCLES(_cycles)  ((long)(_cycles) > 0 ? (long)(_cycles) : 0)   // too slow clocks send too slowly
+#define DSHOT_DELAY_A(_kbits)     DSHOT_DELAY_CYCLES(DSHOT_T0H_CYCLES(_kbits) - DSHOT_T0H_LOOP)
+#define DSHOT_DELAY_B(_kbits)     DSHOT_DELAY_CYCLES(DSHOT_T1H_CYCLES(_kbits) - DSHOT_T0H_CYCLES(_kbits) - (DSHOT_T1H_LOOP - DSHOT_T0H_LOOP))
+#define DSHOT_DELAY_C(_kbits)     DSHOT_DELAY_CYCLES(DSHOT_BIT_CYCLES(_kbits) - DSHOT_T1H_CYCLES(_kbits) - (DSHOT_BIT_LOOP - DSHOT_T1H_LOOP))
+
+// returns the DShot frame for the given pulse width in ticks: 11 bit throttle, telemetry bit 0 and a 4 bit checksum
+static inline unsigned int dshotFrame(unsigned int ticks)
+{
+  // 1000 uS or less is motor stop (0), above that 1001-2000 uS maps to throttle 49-2047
+  unsigned int us = ticksToUs(ticks) + TRIM_DURATION;
+  unsigned int value = 0;
+  if (us > 1000)
+    value = us >= 2000 ? 2047 : 47 + (us - 1000) * 2;
+  value <<= 1;                                    // no telemetry request
+  return (value << 4) | ((value ^ (value >> 4) ^ (value >> 8)) & 0x0F);
+}
 
-	// Extension for slowmove
-	if (SERVO(timer,Channel[timer]).speed) {
-		// Increment ticks by speed until we reach the target.
+#if defined(__AVR__)
+// a delay of exactly _name3 * 3 + _namer cycles: ldi 1, each pass of dec and brne 3 but the last 2, then nops
+#define DSHOT_DELAY(_name)                                                              \
+  ".if %[" _name "3]\n"                                                                 \
+  "ldi %[count], %[" _name "3]\n"                                                       \
+  "2: dec %[count]\n"                                                                   \
+  "brne 2b\n"                                                                           \
+  ".endif\n"                                                                            \
+  ".rept %[" _name "r]\n"                                                               \
+  "nop\n"                                                                               \
+  ".endr\n"
+
+// sends a DShot frame on the pin, most significant bit first, with interrupts already disabled.
+// The bit loop is written in assembly so its cycles are known: every edge is a single store of a
+// port value computed before, a 0 falls at the first store after the rising edge, a 1 at the second
+#define DSHOT_SENDER(_name, _kbits)                                                      \
+static void _name(volatile uint8_t *out, uint8_t mask, unsigned int frame)              \
+{                                                                                        \
+  uint8_t high = *out | mask;                                                            \
+  uint8_t low = *out & ~mask;                                                            \
+  uint8_t value, count, bits;                                                            \
+  asm volatile(                                                                          \
+    "ldi %[bits], 16\n"                                                                  \
+    "0: st %a[out], %[high]\n"          /* rising edge */                                \
+    "mov %[value], %[low]\n"                                                             \
+    "sbrc %B[frame], 7\n"                                                                \
+    "mov %[value], %[high]\n"           /* value is high for a 1 */                      \
+    DSHOT_DELAY("a")                                                                     \
+    "st %a[out], %[value]\n"            /* falling edge of a 0 */                        \
+    DSHOT_DELAY("b")                                                                     \
+    "st %a[out], %[low]\n"              /* falling edge of a 1 */                        \
+    "lsl %A[frame]\n"                                                                    \
+    "rol %B[frame]\n"                                                                    \
+    DSHOT_DELAY("c")                                                                     \
+    "dec %[bits]\n"                                                                      \
+    "brne 0b\n"                                                                          \
+    : [frame] "+r" (frame), [value] "=&r" (value), [count] "=&d" (count), [bits] "=&d" (bits) \
+    : [out] "e" (out), [high] "r" (high), [low] "r" (low),                               \
+      [a3] "n" (DSHOT_DELAY_A(_kbits) / 3), [ar] "n" (DSHOT_DELAY_A(_kbits) % 3),        \
+      [b3] "n" (DSHOT_DELAY_B(_kbits) / 3), [br] "n" (DSHOT_DELAY_B(_kbits) % 3),        \
+      [c3] "n" (DSHOT_DELAY_C(_kbits) / 3), [cr] "n" (DSHOT_DELAY_C(_kbits) % 3)         \
+    : "memory");                                                                         \
+}
+#else
+// without the AVR instructions (host tests) the frame is written without its timing
+#define DSHOT_SENDER(_name, _kbits)                                                      \
+static void _name(volatile uint8_t *out, uint8_t mask, unsigned int frame)              \
+{                                                                                        \
+  for (uint8_t bit = 16; bit; bit--) {                                                   \
+    *out |= mask;                                                                        \
+    *out &= ~mask;                                                                       \
+  }                                                                                      \
+}
+#endif
+
+DSHOT_SENDER(dshot150Send, 150)
+DSHOT_SENDER(dshot300Send, 300)
+
+// true if stopAll() or setTicks() changed the servo since its object last wrote it, read again on every call
+static inline bool retargeted(servo_t *servo)
+{
+  return ((volatile servo_t *)servo)->retargeted;
+}
+
+// ends any move in progress at the exact current position
+static inline void freeze(servo_t *servo)
+{
+  servo->target = servo->ticks;
+#if defined(VARSPEEDSERVO_FILTERS)
+  servo->history[0] = servo->ticks;
+  servo->history[1] = servo->ticks;
+#endif
+  servo->fraction = 0;
+  servo->velocity = 0;
+  servo->speed = 0;
+}
+
+// ends following an input channel or a mix, and the analog input if the servo follows it,
+// call with interrupts disabled
+static inline void unfollow(ServoController *engine, uint8_t index, servo_t *servo)
+{
+  servo->input = 0;
+#if defined(VARSPEEDSERVO_MIX)
+  servo->mixInput = 0;
+#endif
+#if defined(_useAnalog)
+  if( AnalogServo == index + 1 && AnalogEngine == engine ) {
+    AnalogServo = 0;
+    ADCSRA &= ~_BV(ADIE);
+  }
+#endif
+}
+
+// Extension for slowmove
+// advances a move in progress by one refresh frame
+static inline void slowmove(servo_t *servo)
+{
+	if (servo->speed) {
+		// Move ticks towards the target at up to speed until we reach it.
+		// speed, velocity and the position are 8.8 fixed point so slow rates still advance every frame.
+		// Without acceleration the servo moves at full speed and lands exactly on the target.
+		// With acceleration the velocity ramps up, is kept when the target changes (braking and
+		// reversing if the new target is behind) and ramps down to stop on the target.
 		// When the target is reached, speed is set to 0 to disable that code.
-		if (SERVO(timer,Channel[timer]).target > SERVO(timer,Channel[timer]).ticks) {
-			SERVO(timer,Channel[timer]).ticks += SERVO(timer,Channel[timer]).speed;
-			if (SERVO(timer,Channel[timer]).target <= SERVO(timer,Channel[timer]).ticks) {
-				SERVO(timer,Channel[timer]).ticks = SERVO(timer,Channel[timer]).target;
-				SERVO(timer,Channel[timer]).speed = 0;
+		long position = ((long)servo->ticks << 8) | servo->fraction;
+		long distance = ((long)servo->target << 8) - position;
+		unsigned long remaining = distance < 0 ? -distance : distance;
+		long accel = servo->acceleration;
+		long velocity;                    // velocity towards the target
+		if (accel == 0) {
+			velocity = servo->speed;
+		}
+		else {
+			long speed = servo->speed > 0x7FFF ? 0x7FFF : servo->speed;    // velocity is kept in an int
+			velocity = distance < 0 ? -servo->velocity : servo->velocity;
+			if (velocity < 0) {                 // heading away from the target, brake
+				velocity += accel;
+			}
+			else {
+				// change towards speed (a lower one if the target changed) if we can still stop in time
+				// afterwards, brake if we can't stop at the current velocity
+				long next;
+				if (velocity < speed)
+					next = velocity + accel < speed ? velocity + accel : speed;
+				else
+					next = velocity - accel > speed ? velocity - accel : speed;
+				if (brakingDistance(next, accel) <= remaining)
+					velocity = next;
+				else if (brakingDistance(velocity, accel) >= remaining)
+					velocity -= accel;
+				long slowest = accel < speed ? accel : speed;
+				if (velocity < slowest)
+					velocity = slowest;
 			}
 		}
+		if (velocity >= 0 && (unsigned long)velocity >= remaining && (accel == 0 || velocity <= accel)) {
+			position = (long)servo->target << 8;
+			servo->velocity = 0;
+			servo->speed = 0;
+		}
 		else {
-			SERVO(timer,Channel[timer]).ticks -= SERVO(timer,Channel[timer]).speed;
-			if (SERVO(timer,Channel[timer]).target >= SERVO(timer,Channel[timer]).ticks) {
-				SERVO(timer,Channel[timer]).ticks = SERVO(timer,Channel[timer]).target;
-				SERVO(timer,Channel[timer]).speed = 0;
+			// moving too fast to stop on the target overshoots it, the next frames brake and come back,
+			// but never past the limits of the servo, where it stops
+			if (distance < 0)
+				velocity = -velocity;
+			position += velocity;
+			if (position < ((long)servo->minTicks << 8)) {
+				position = (long)servo->minTicks << 8;
+				velocity = 0;
+			}
+			else if (position > ((long)servo->maxTicks << 8)) {
+				position = (long)servo->maxTicks << 8;
+				velocity = 0;
 			}
+			servo->velocity = constrain(velocity, -0x7FFF, 0x7FFF);
 		}
+		servo->ticks = position >> 8;
+		servo->fraction = position;
 	}
-	// End of Extension for slowmove
+}
+// End of Extension for slowmove
+
+// returns the pulse width in ticks to send for this frame
+static inline unsigned int pulseTicks(servo_t *servo)
+{
+  unsigned int pulse = servo->ticks;
+  if(servo->Pin.dither) {
+    // sigma-delta: accumulate the fraction every frame and send one tick more on each carry,
+    // so the average pulse width has 1/256 tick resolution
+    uint8_t error = servo->ditherError + servo->fraction;
+    if(error < servo->ditherError)
+      pulse++;
+    servo->ditherError = error;
+  }
+  return pulse;
+}
+
+// samples the analog input once per frame of the timer of the servo following it
+static inline void startAnalog(ServoController *engine, timer16_Sequence_t timer)
+{
+#if defined(_useAnalog)
+  if( AnalogServo && AnalogEngine == engine && AnalogTimer == timer )
+    ADCSRA |= _BV(ADSC);   // the ADC interrupt sets the servo in time for its next pulse
+#endif
+}
+
+// sets the pin of the servo high or low, with interrupts disabled
+// the port and mask are looked up by attach so each edge is a single read-modify-write of the port,
+// digitalWrite() looks them up on every call
+static inline void pinHigh(servo_t *servo)
+{
+#if defined(VARSPEEDSERVO_DIGITALWRITE)
+  digitalWrite(servo->Pin.nbr, HIGH);
+#else
+  *servo->out |= servo->mask;
+#endif
+}
+
+static inline void pinLow(servo_t *servo)
+{
+#if defined(VARSPEEDSERVO_DIGITALWRITE)
+  digitalWrite(servo->Pin.nbr, LOW);
+#else
+  *servo->out &= ~servo->mask;
+#endif
+}
+
+// sets the servo from the input channel it follows or the input channels it mixes, if any
+static inline void followInput(servo_t *servo)
+{
+  if( servo->input ) {
+    uint8_t channel = servo->input - 1;
+    unsigned int ticks = InputTicks[channel];
+    if( ticks ) {                         // 0 is no input yet, a mix of any value is not
+      long level = ticks;
+#if defined(VARSPEEDSERVO_MIX)
+      if( servo->weight != MIX_UNITY || servo->mixInput ) {
+        // weighted sum of the deviations from center, 16 x 8 bit products and a single shift
+        const int center = usToTicks(DEFAULT_PULSE_WIDTH);
+        long sum = (long)(int)(ticks - center) * servo->weight;
+        if( servo->mixInput ) {
+          unsigned int mixTicks = InputTicks[servo->mixInput - 1];
+          if( mixTicks )
+            sum += (long)(int)(mixTicks - center) * servo->mixWeight;
+        }
+        level = (sum >> 6) + center;
+      }
+#endif
+      level -= usToTicks(TRIM_DURATION);   // compensate for interrupt overhead like writeMicroseconds
+      ticks = constrain(level, (long)servo->minTicks, (long)servo->maxTicks);   // saturate to the servo range
+      if( FILTER_OF(servo) ) {
+        servo->target = ticks;
+      }
+      else {
+        servo->ticks = ticks;
+        servo->fraction = 0;
+      }
+      servo->velocity = 0;
+      servo->speed = 0;
+      if( InputFresh & _BV(channel) ) {
+        InputLatency = (uint16_t)(INPUT_CLOCK() - InputStamp[channel]);
+        InputFresh &= ~_BV(channel);
+      }
+    }
+  }
+}
+
+// moves a filtered servo towards the position last written, slow moves are left alone
+static inline void filterTarget(servo_t *servo)
+{
+#if defined(VARSPEEDSERVO_FILTERS)
+  if( servo->filter == FILTER_NONE )
+    return;
+  if( servo->speed ) {
+    // the median starts over at the target, or the frame a move ends in takes a value from before it
+    servo->history[0] = servo->target;
+    servo->history[1] = servo->target;
+    return;
+  }
+
+  unsigned int target = servo->target;
+  if( servo->filter == FILTER_MEDIAN ) {
+    unsigned int a = servo->history[0];
+    unsigned int b = servo->history[1];
+    servo->history[1] = a;
+    servo->history[0] = target;
+    if( a > b ) {      // order a <= b, the median is then target limited to a..b
+      unsigned int t = a;
+      a = b;
+      b = t;
+    }
+    servo->ticks = constrain(target, a, b);
+    servo->fraction = 0;
+  }
+  else {
+    // Q8.8 position, the last tick is taken at once rather than in ever smaller fractions
+    long position = ((long)servo->ticks << 8) | servo->fraction;
+    long error = ((long)target << 8) - position;
+    position += error >> servo->filter;
+    error = ((long)target << 8) - position;
+    if( error < 256 && error > -256 ) {
+      servo->ticks = target;
+      servo->fraction = 0;
+    }
+    else {
+      servo->ticks = position >> 8;
+      servo->fraction = position;
+    }
+  }
+#endif
+}
+
+// true if the servo's pulse stays the same until it is written again
+static inline bool isIdle(servo_t *servo)
+{
+  if( servo->input || servo->speed )
+    return false;
+#if defined(VARSPEEDSERVO_FILTERS)
+  if( servo->filter == FILTER_NONE )
+    return true;
+  return servo->ticks == servo->target && servo->fraction == 0 &&
+         servo->history[0] == servo->target && servo->history[1] == servo->target;
+#else
+  return true;
+#endif
+}
+
+// marks a servo as moving, following or filtering so the interrupt handler updates it at every frame,
+// call with interrupts disabled
+inline void ServoController::markDirty(uint8_t index)
+{
+  dirty[SERVO_INDEX_TO_TIMER(index)] |= _BV(SERVO_INDEX_TO_CHANNEL(index));
+}
+
+// returns the refresh interval in uS of the given timer
+inline unsigned int ServoController::refreshInterval(timer16_Sequence_t timer)
+{
+  return refresh[timer] ? refresh[timer] : REFRESH_INTERVAL;
+}
+
+// freezes every servo on the timer if stopAll() was called, at the start of a refresh frame
+inline void ServoController::checkStopRequest(timer16_Sequence_t timer)
+{
+  if( stopRequest & _BV(timer) ) { // emergency stop, freeze every servo before pulsing this frame
+    for(uint8_t index=0; index < SERVOS_PER_TIMER; index++) {
+      freeze(&SERVO(timer,index));
+      unfollow(this, SERVO_INDEX(timer,index), &SERVO(timer,index));   // or the next frame takes the input again
+      SERVO(timer,index).retargeted = true;
+    }
+    stopRequest &= ~_BV(timer);
+    updates++;
+  }
+}
+
+// returns the ticks from now until the end of the refresh interval, or a few ticks if it has elapsed
+inline unsigned int ServoController::ticksToRefresh(timer16_Sequence_t timer, unsigned int now, unsigned int minimum)
+{
+  unsigned int interval = usToTicks(refreshInterval(timer));
+  unsigned int elapsed = (uint16_t)(now - frameStart[timer]);   // the timer count wraps around
+  if( elapsed < interval && interval - elapsed > minimum )
+    return interval - elapsed;
+  return minimum;
+}
+
+// does the work of a frame for the current channel of the timer, unless the servo is idle
+inline void ServoController::updateServo(timer16_Sequence_t timer, servo_t *servo)
+{
+  uint16_t channelBit = _BV(channel[timer]);
+  if( dirty[timer] & channelBit ) {
+    updates++;
+    followInput(servo);
+    slowmove(servo);
+    filterTarget(servo);
+    if( isIdle(servo) )
+      dirty[timer] &= ~channelBit;
+  }
+}
+
+#if defined(VARSPEEDSERVO_NESTED_INTERRUPTS)
+// as updateServo, but runs the slow move and filter math with interrupts enabled, call with the
+// compare match of the timer not yet set so this interrupt can't nest in itself.
+// Inputs are read before, setTicks() on this servo meanwhile is applied after.
+inline void ServoController::updateServoNested(timer16_Sequence_t timer, servo_t *servo)
+{
+  uint16_t channelBit = _BV(channel[timer]);
+  if( dirty[timer] & channelBit ) {
+    updates++;
+    followInput(servo);
+    uint8_t index = SERVO_INDEX(timer,channel[timer]);
+    volatile uint8_t *busy = &updating[timer];      // stored in order with the enabling of interrupts
+    *busy = index + 1;
+    uint8_t oldSREG = SREG;
+    sei();
+    slowmove(servo);
+    filterTarget(servo);
+    SREG = oldSREG;
+    *busy = 0;
+    if( deferredTicks[timer] ) {
+      setTicks(index, deferredTicks[timer]);
+      deferredTicks[timer] = 0;
+    }
+    if( isIdle(servo) )
+      dirty[timer] &= ~channelBit;
+  }
+}
+#endif
+
+// sends the servos of a timer as one PPM stream: every channel starts with a marker pulse and
+// lasts the pulse width of its servo, the marker after the last channel is followed by the sync gap
+inline void ServoController::handlePpm(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA)
+{
+  uint8_t pin = ppmPin[timer] - 1;
+  if( ppmMarker[timer] ) {
+    digitalWrite(pin, LOW);    // end of the marker, wait for the end of the channel
+    ppmMarker[timer] = false;
+    *OCRnA = ppmSlotEnd[timer];
+    return;
+  }
+
+  if( channel[timer] < 0 ) {
+    frameStart[timer] = *OCRnA; // channel set to -1 indicated that refresh interval completed, the timer runs on
+    checkStopRequest(timer);
+    startAnalog(this, timer);
+  }
+
+  unsigned int now = *TCNTn;
+  unsigned int slot;
+  channel[timer]++;    // increment to the next channel
+  if( SERVO_INDEX(timer,channel[timer]) < servoCount && channel[timer] < SERVOS_PER_TIMER) {
+    servo_t *servo = &SERVO(timer,channel[timer]);
+    updateServo(timer, servo);
+    slot = pulseTicks(servo);
+  }
+  else {
+    // the marker after the last channel ends it, the rest of the refresh interval is the sync gap
+    slot = ticksToRefresh(timer, now, usToTicks(PPM_MIN_SYNC));
+    channel[timer] = -1; // this will get incremented at the end of the refresh period to start again at the first channel
+  }
+  if( slot < usToTicks(PPM_MARKER_WIDTH) + 4 )
+    slot = usToTicks(PPM_MARKER_WIDTH) + 4;   // the channel must end after its marker, or its compare match is missed
+  ppmSlotEnd[timer] = now + slot;
+  *OCRnA = now + usToTicks(PPM_MARKER_WIDTH);
+  digitalWrite(pin, HIGH);
+  ppmMarker[timer] = true;
+}
+
+// ends the current pulse and starts the next, the work of handleInterrupt() inlined into its callers here
+inline void ServoController::handleEdge(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA)
+{
+  unsigned int late = (uint16_t)(*TCNTn - *OCRnA);   // ticks this edge is later than scheduled
+  if( late > lateTicks )
+    lateTicks = late;
+
+  if( ppmPin[timer] ) {
+    handlePpm(timer, TCNTn, OCRnA);
+    return;
+  }
+
+  if( channel[timer] < 0 ) {
+    frameStart[timer] = *OCRnA; // channel set to -1 indicated that refresh interval completed, the timer runs on
+    checkStopRequest(timer);
+    startAnalog(this, timer);
+  }
+  else{
+    if( SERVO_INDEX(timer,channel[timer]) < servoCount && SERVO(timer,channel[timer]).Pin.isActive == true )
+      pinLow(&SERVO(timer,channel[timer])); // pulse this channel low if activated
+  }
+
+  channel[timer]++;    // increment to the next channel
+  if( SERVO_INDEX(timer,channel[timer]) < servoCount && channel[timer] < SERVOS_PER_TIMER) {
+
+	servo_t *servo = &SERVO(timer,channel[timer]);
+#if defined(VARSPEEDSERVO_NESTED_INTERRUPTS)
+    if(protocol[timer] < ESC_DSHOT150) {
+      // start the pulse at once and time it from here, the update is done while it is high
+      unsigned int start = *TCNTn;
+      if(servo->Pin.isActive == true)
+        pinHigh(servo);
+      updateServoNested(timer, servo);
+      unsigned int end = start + (servo->Pin.isActive == true ? pulseTicks(servo) : 4);
+      unsigned int now = *TCNTn;
+      if( (int16_t)(end - now) < 4 )
+        end = now + 4;                  // nested interrupts held the update past the end of the pulse
+      *OCRnA = end;
+      return;
+    }
+#endif
+	updateServo(timer, servo);
 
 	// Todo
 
-    *OCRnA = *TCNTn + SERVO(timer,Channel[timer]).ticks;
-    if(SERVO(timer,Channel[timer]).Pin.isActive == true)     // check if activated
-      digitalWrite( SERVO(timer,Channel[timer]).Pin.nbr,HIGH); // its an active channel so pulse it high
+    if(protocol[timer] >= ESC_DSHOT150) {
+      // DShot sends the whole frame now and goes on with the next channel right after it
+      if(servo->Pin.isActive == true) {
+        unsigned int frame = dshotFrame(servo->ticks);
+        if(protocol[timer] == ESC_DSHOT150)
+          dshot150Send(servo->out, servo->mask, frame);
+        else
+          dshot300Send(servo->out, servo->mask, frame);
+      }
+      *OCRnA = *TCNTn + 4;  // allow a few ticks to ensure the next OCR1A not missed
+      return;
+    }
+
+    if(servo->Pin.isActive == true) {   // check if activated
+      *OCRnA = *TCNTn + pulseTicks(servo);
+      pinHigh(servo);                   // its an active channel so pulse it high
+    }
+    else
+      *OCRnA = *TCNTn + 4;              // a channel without a pin takes none of the frame
   }
   else {
     // finished all channels so wait for the refresh period to expire before starting over
-    if( (unsigned)*TCNTn <  (usToTicks(REFRESH_INTERVAL) + 4) )  // allow a few ticks to ensure the next OCR1A not missed
-      *OCRnA = (unsigned int)usToTicks(REFRESH_INTERVAL);
-    else
-      *OCRnA = *TCNTn + 4;  // at least REFRESH_INTERVAL has elapsed
-    Channel[timer] = -1; // this will get incremented at the end of the refresh period to start again at the first channel
+    unsigned int now = *TCNTn;
+    *OCRnA = now + ticksToRefresh(timer, now, 4);  // allow a few ticks to ensure the next OCR1A not missed
+    channel[timer] = -1; // this will get incremented at the end of the refresh period to start again at the first channel
   }
 }
 
+/*
+  handleInterrupt(timer, count, compare) - Run an engine from a timer of its owner.
+
+  Call at each compare match with the count and compare registers of the timer, ends the current
+  pulse, starts the next and sets compare to the time of the next edge.
+*/
+void ServoController::handleInterrupt(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA)
+{
+  handleEdge(timer, TCNTn, OCRnA);
+}
+
+// the body of the timer interrupt handlers of ServoEngine, which saves them a call
+inline void servoInterrupt(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA)
+{
+  ServoEngine.handleEdge(timer, TCNTn, OCRnA);
+}
+
 #ifndef WIRING // Wiring pre-defines signal handlers so don't define any if compiling for the Wiring platform
 // Interrupt handlers for Arduino
 #if defined(_useTimer1)
 SIGNAL (TIMER1_COMPA_vect)
 {
-  handle_interrupts(_timer1, &TCNT1, &OCR1A);
+  servoInterrupt(_timer1, &TCNT1, &OCR1A);
 }
 #endif
 
 #if defined(_useTimer3)
 SIGNAL (TIMER3_COMPA_vect)
 {
-  handle_interrupts(_timer3, &TCNT3, &OCR3A);
+  servoInterrupt(_timer3, &TCNT3, &OCR3A);
+}
+#endif
+
+#if defined(_useTimer2)
+// returns the extended Timer2 count in ticks, call with interrupts disabled
+static inline uint16_t timer2Count()
+{
+  uint8_t low = TCNT2;
+  uint8_t high = Timer2High;
+  if( (TIFR2 & _BV(TOV2)) && low < 128 )
+    high++;                           // overflowed, the overflow interrupt hasn't run yet
+  return (((uint16_t)high << 8) | low) << TIMER2_SHIFT;
+}
+
+SIGNAL (TIMER2_OVF_vect)
+{
+  Timer2High++;
+}
+
+// the wait before a new frame can be more than half the counter range, so the compare is due once the
+// ticks since it was set reach the ticks it was set ahead; a compare missed while setting it is caught
+// by checking again
+SIGNAL (TIMER2_COMPA_vect)
+{
+  volatile uint16_t count = timer2Count();
+  while( (uint16_t)(count - Timer2CompareSet) >= (uint16_t)(Timer2Compare - Timer2CompareSet) ) {
+    servoInterrupt(_timer2, &count, &Timer2Compare);
+    // round to a Timer2 count, so edges are at most half a count early or late
+    Timer2Compare = (Timer2Compare + _BV(TIMER2_SHIFT - 1)) & ~(_BV(TIMER2_SHIFT) - 1);
+    Timer2CompareSet = count;
+    OCR2A = Timer2Compare >> TIMER2_SHIFT;
+    count = timer2Count();
+  }
 }
 #endif
 
 #if defined(_useTimer4)
 SIGNAL (TIMER4_COMPA_vect)
 {
-  handle_interrupts(_timer4, &TCNT4, &OCR4A);
+  servoInterrupt(_timer4, &TCNT4, &OCR4A);
 }
 #endif
 
 #if defined(_useTimer5)
 SIGNAL (TIMER5_COMPA_vect)
 {
-  handle_interrupts(_timer5, &TCNT5, &OCR5A);
+  servoInterrupt(_timer5, &TCNT5, &OCR5A);
+}
+#endif
+
+#if defined(_useCapture1)
+// decodes the RC receiver signal on the input capture pin
+SIGNAL (TIMER1_CAPT_vect)
+{
+  unsigned int now = ICR1;
+  unsigned int width = (uint16_t)(now - CaptureLast);
+  unsigned int stamp = INPUT_CLOCK() - (uint16_t)(TCNT1 - now);   // the time of the edge, Timer1 runs at ticks here
+  CaptureLast = now;
+
+  if( CaptureMode == CAPTURE_PWM ) {
+    // capture the rising edge, then the falling edge that ends the pulse
+    if( TCCR1B & _BV(ICES1) ) {
+      TCCR1B &= ~_BV(ICES1);
+    }
+    else {
+      TCCR1B |= _BV(ICES1);
+      InputTicks[0] = width;
+      InputStamp[0] = stamp;
+      InputFresh |= _BV(0);
+    }
+  }
+  else {
+    // PPM channels are the times between rising edges, a long gap marks the start of a frame
+    if( width > usToTicks(CAPTURE_PPM_SYNC) ) {
+      CaptureChannel = 0;
+    }
+    else if( CaptureChannel < MAX_INPUT_CHANNELS ) {
+      InputTicks[CaptureChannel] = width;
+      InputStamp[CaptureChannel] = stamp;
+      InputFresh |= _BV(CaptureChannel);
+      CaptureChannel++;
+    }
+  }
+}
+#endif
+
+#if defined(_useAnalog)
+// sets the servo following the ADC from the new sample, scaled to its pulse range
+SIGNAL (ADC_vect)
+{
+  unsigned int sample = ADC;
+  int change = (int16_t)(sample - AnalogLast);
+  if( AnalogServo == 0 || (change <= AnalogDeadband && change >= -AnalogDeadband) )
+    return;
+  AnalogLast = sample;
+
+  sample += sample >> 9;     // 0 to 1024, so full scale reaches the maximum with a shift instead of a division
+  AnalogEngine->setTicks(AnalogServo - 1, AnalogMinTicks + ((unsigned long)AnalogSpanTicks * sample >> 10));
+}
+#endif
+
+#if defined(VARSPEEDSERVO_SERIAL_INPUT)
+// use the second UART where there is one, so Serial stays free for the USB connection
+#if defined(UCSR1A)
+#define SERIAL_INPUT_UCSRA UCSR1A
+#define SERIAL_INPUT_UCSRB UCSR1B
+#define SERIAL_INPUT_UCSRC UCSR1C
+#define SERIAL_INPUT_UBRR  UBRR1
+#define SERIAL_INPUT_UDR   UDR1
+#define SERIAL_INPUT_U2X   U2X1
+#define SERIAL_INPUT_UPM1  UPM11
+#define SERIAL_INPUT_USBS  USBS1
+#define SERIAL_INPUT_UCSZ1 UCSZ11
+#define SERIAL_INPUT_UCSZ0 UCSZ10
+#define SERIAL_INPUT_RXEN  RXEN1
+#define SERIAL_INPUT_RXCIE RXCIE1
+#define SERIAL_INPUT_ERROR (_BV(FE1) | _BV(DOR1) | _BV(UPE1))
+#define SERIAL_INPUT_vect  USART1_RX_vect
+#else
+#define SERIAL_INPUT_UCSRA UCSR0A
+#define SERIAL_INPUT_UCSRB UCSR0B
+#define SERIAL_INPUT_UCSRC UCSR0C
+#define SERIAL_INPUT_UBRR  UBRR0
+#define SERIAL_INPUT_UDR   UDR0
+#define SERIAL_INPUT_U2X   U2X0
+#define SERIAL_INPUT_UPM1  UPM01
+#define SERIAL_INPUT_USBS  USBS0
+#define SERIAL_INPUT_UCSZ1 UCSZ01
+#define SERIAL_INPUT_UCSZ0 UCSZ00
+#define SERIAL_INPUT_RXEN  RXEN0
+#define SERIAL_INPUT_RXCIE RXCIE0
+#define SERIAL_INPUT_ERROR (_BV(FE0) | _BV(DOR0) | _BV(UPE0))
+#if defined(USART_RX_vect)
+#define SERIAL_INPUT_vect  USART_RX_vect
+#else
+#define SERIAL_INPUT_vect  USART0_RX_vect
+#endif
+#endif
+
+// decodes SBUS/iBUS bytes as they are received
+SIGNAL (SERIAL_INPUT_vect)
+{
+  uint8_t status = SERIAL_INPUT_UCSRA;
+  uint8_t data = SERIAL_INPUT_UDR;
+  if(status & SERIAL_INPUT_ERROR)
+    SerialIndex = 0;                  // drop the packet and resynchronize on the next header
+  else
+    VarSpeedServo::serialInput(data);
 }
 #endif
 
@@ -187,13 +945,13 @@ SIGNAL (TIMER5_COMPA_vect)
 #if defined(_useTimer1)
 void Timer1Service()
 {
-  handle_interrupts(_timer1, &TCNT1, &OCR1A);
+  servoInterrupt(_timer1, &TCNT1, &OCR1A);
 }
 #endif
 #if defined(_useTimer3)
 void Timer3Service()
 {
-  handle_interrupts(_timer3, &TCNT3, &OCR3A);
+  servoInterrupt(_timer3, &TCNT3, &OCR3A);
 }
 #endif
 #endif
@@ -204,7 +962,7 @@ static void initISR(timer16_Sequence_t timer)
 #if defined (_useTimer1)
   if(timer == _timer1) {
     TCCR1A = 0;             // normal counting mode
-    TCCR1B = _BV(CS11);     // set prescaler of 8
+    TCCR1B = (TCCR1B & (_BV(ICNC1) | _BV(ICES1))) | _BV(CS11);     // set prescaler of 8, keep the input capture setup
     TCNT1 = 0;              // clear the timer count
 #if defined(__AVR_ATmega8__)|| defined(__AVR_ATmega128__)
     TIFR |= _BV(OCF1A);      // clear any pending interrupts;
@@ -220,6 +978,20 @@ static void initISR(timer16_Sequence_t timer)
   }
 #endif
 
+#if defined (_useTimer2)
+  if(timer == _timer2) {
+    TCCR2A = 0;             // normal counting mode
+    TCCR2B = _BV(CS21) | _BV(CS20);     // set prescaler of 32, one count is four ticks
+    TCNT2 = 0;              // clear the timer count
+    Timer2High = 0;
+    Timer2Compare = 256 << TIMER2_SHIFT;  // the first compare match, after one round of Timer2, starts a frame
+    Timer2CompareSet = 0;
+    OCR2A = 0;
+    TIFR2 = _BV(OCF2A) | _BV(TOV2);     // clear any pending interrupts;
+    TIMSK2 = _BV(OCIE2A) | _BV(TOIE2);  // enable the output compare and overflow interrupts
+  }
+#endif
+
 #if defined (_useTimer3)
   if(timer == _timer3) {
     TCCR3A = 0;             // normal counting mode
@@ -284,29 +1056,189 @@ static void finISR(timer16_Sequence_t timer)
 #endif
 }
 
-static boolean isTimerActive(timer16_Sequence_t timer)
+// returns the time in milliseconds until the move of a copy of a servo ends, running slowmove() on the
+// copy frame by frame like the interrupt handler; frames at full speed that leave room to stop
+// afterwards are taken at once, so only the ramps of an accelerated move are stepped, at most about
+// 2 * sqrt(distance / acceleration) frames
+static unsigned long moveTime(servo_t servo, unsigned int interval)
+{
+  unsigned long frames = 0;
+  while (servo.speed) {
+    long position = ((long)servo.ticks << 8) | servo.fraction;
+    long distance = ((long)servo.target << 8) - position;
+    unsigned long remaining = distance < 0 ? -distance : distance;
+    long accel = servo.acceleration;
+    long speed = accel && servo.speed > 0x7FFF ? 0x7FFF : servo.speed;    // as slowmove() limits it
+    long velocity = distance < 0 ? -servo.velocity : servo.velocity;
+    if (accel == 0 || velocity == speed) {
+      unsigned long braking = accel ? brakingDistance(speed, accel) : 0;
+      if (remaining > braking + speed) {
+        unsigned long cruise = (remaining - braking - 1) / speed;      // none of them lands or brakes
+        position += distance < 0 ? -(long)(cruise * speed) : (long)(cruise * speed);
+        servo.ticks = position >> 8;
+        servo.fraction = position;
+        frames += cruise;
+      }
+    }
+    slowmove(&servo);
+    frames++;
+  }
+  // split the multiplication so long moves at slow speeds can't overflow
+  return (frames / 1000) * interval + (frames % 1000) * interval / 1000;
+}
+
+/****************** end of static functions ******************************/
+
+bool ServoController::isTimerActive(timer16_Sequence_t timer)
 {
   // returns true if any servo is active on this timer
-  for(uint8_t channel=0; channel < SERVOS_PER_TIMER; channel++) {
-    if(SERVO(timer,channel).Pin.isActive == true)
+  for(uint8_t index=0; index < SERVOS_PER_TIMER; index++) {
+    if(SERVO(timer,index).Pin.isActive == true)
       return true;
   }
   return false;
 }
 
+/*
+  setTicks(index, ticks) - Set a servo from an interrupt handler.
 
-/****************** end of static functions ******************************/
+  Used for inputs that arrive in their own interrupt, like the ADC. The servo is set at once,
+  or becomes the target of its filter, and any slow move ends. Call with interrupts disabled.
+*/
+void ServoController::setTicks(uint8_t index, unsigned int ticks)
+{
+  if( index >= servoCount )
+    return;
+#if defined(VARSPEEDSERVO_NESTED_INTERRUPTS)
+  timer16_Sequence_t timer = SERVO_INDEX_TO_TIMER(index);
+  if( updating[timer] == index + 1 ) {
+    deferredTicks[timer] = ticks;     // the interrupt this one nests in is moving the servo, it sets it when done
+    return;
+  }
+#endif
+  servo_t *servo = &servos[index];
+  if( FILTER_OF(servo) ) {
+    servo->target = ticks;
+    markDirty(index);
+  }
+  else {
+    servo->ticks = ticks;
+    servo->fraction = 0;
+  }
+  servo->velocity = 0;
+  servo->speed = 0;
+  servo->retargeted = true;
+  updates++;
+}
+
+uint8_t ServoController::count()
+{
+  return servoCount;
+}
+
+/*
+  edgeDelay() - Worst delay of a pulse edge since the last call.
+
+  Returns how many microseconds the interrupt handler started later than the timer compare match
+  at worst, and starts over. The delay is the time other interrupt handlers and code running with
+  interrupts disabled held the servo interrupt off; it lengthens the pulse ending at that edge.
+*/
+unsigned int ServoController::edgeDelay()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  unsigned int ticks = lateTicks;
+  lateTicks = 0;
+  SREG = oldSREG;
+  return ticksToUs(ticks);
+}
+
+/*
+  service() - Run an engine without a timer of its own, from micros().
+
+  Does the work the timer interrupt would have done for every pulse edge that is due. Call it from
+  loop() as often as possible, or from a periodic interrupt the sketch already has. Each pulse ends
+  at the first call after it is due, so it is too long by the time between calls plus the 4 uS
+  resolution of micros() (at 16 MHz); edgeDelay() shows the worst case. Slow moves, filters and
+  sequences work as with a hardware timer. Once service() has been called, wait() and escCalibrate()
+  of servos on this engine keep calling it. Not for ServoEngine, which its timers run. A call from an
+  interrupt while service() runs, as with VARSPEEDSERVO_NESTED_INTERRUPTS, returns at once.
+*/
+void ServoController::service()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if( servicing ) {                   // the running call handles the edges that are due
+    SREG = oldSREG;
+    return;
+  }
+  servicing = true;
+  SREG = oldSREG;
+  for(uint8_t index = 0; index < _Nbr_16timers; index++) {
+    timer16_Sequence_t timer = (timer16_Sequence_t)index;
+    uint8_t oldSREG = SREG;
+    cli();
+    if( isTimerActive(timer) == false ) {
+      polled &= ~_BV(timer);
+    }
+    else {
+      volatile uint16_t count = SERVICE_CLOCK();
+      if( (polled & _BV(timer)) == 0 ) {
+        polled |= _BV(timer);
+        channel[timer] = -1;            // start with a new frame
+        compare[timer] = count;
+        compareSet[timer] = count;
+      }
+      // the wait before a new frame can be more than half the counter range, so the match is due once
+      // the ticks since the compare was set reach the ticks it was set ahead
+      while( (uint16_t)(count - compareSet[timer]) >= (uint16_t)(compare[timer] - compareSet[timer]) ) {
+        handleEdge(timer, &count, &compare[timer]);
+        compareSet[timer] = count;
+        count = SERVICE_CLOCK();
+      }
+    }
+    SREG = oldSREG;
+  }
+  servicing = false;
+}
+
+// waits ms milliseconds, running the engine meanwhile if it is run by service()
+void ServoController::pause(unsigned long ms)
+{
+  if( polled == 0 ) {
+    delay(ms);
+    return;
+  }
+  unsigned long start = millis();
+  while( millis() - start < ms )
+    service();
+}
+
+VarSpeedServo::VarSpeedServo() : VarSpeedServo(ServoEngine)
+{
+}
 
-VarSpeedServo::VarSpeedServo()
+VarSpeedServo::VarSpeedServo(ServoController &controller)
 {
-  if( ServoCount < MAX_SERVOS) {
-    this->servoIndex = ServoCount++;                    // assign a servo index to this instance
-	  servos[this->servoIndex].ticks = usToTicks(DEFAULT_PULSE_WIDTH);   // store default values  - 12 Aug 2009
-    this->curSeqPosition = 0;
-    this->curSequence = initSeq;
+  this->engine = &controller;
+  if( engine->servoCount < MAX_SERVOS) {
+    this->servoIndex = engine->servoCount++;            // assign a servo index to this instance
+	  engine->servos[this->servoIndex].ticks = usToTicks(DEFAULT_PULSE_WIDTH);   // store default values  - 12 Aug 2009
+    engine->servos[this->servoIndex].minTicks = usToTicks(MIN_PULSE_WIDTH - TRIM_DURATION);
+    engine->servos[this->servoIndex].maxTicks = usToTicks(MAX_PULSE_WIDTH - TRIM_DURATION);
   }
   else
     this->servoIndex = INVALID_SERVO ;  // too many servos
+  this->min = MIN_PULSE_WIDTH;          // default limits until attach() is called
+  this->max = MAX_PULSE_WIDTH;
+#if defined(VARSPEEDSERVO_CURVES)
+  this->trim = 0;
+  this->expo = 0;
+  this->reversed = false;
+#endif
+  updateCurve();
+  this->curSeqPosition = 0;
+  this->curSequence = initSeq;
 }
 
 uint8_t VarSpeedServo::attach(int pin)
@@ -316,73 +1248,735 @@ uint8_t VarSpeedServo::attach(int pin)
 
 uint8_t VarSpeedServo::attach(int pin, int min, int max)
 {
-  if(this->servoIndex < MAX_SERVOS ) {
-    pinMode( pin, OUTPUT) ;                                   // set servo pin to output
-    servos[this->servoIndex].Pin.nbr = pin;
-    // todo min/max check: abs(min - MIN_PULSE_WIDTH) /4 < 128
-    this->min  = (MIN_PULSE_WIDTH - min)/4; //resolution of min/max is 4 uS
-    this->max  = (MAX_PULSE_WIDTH - max)/4;
-    // initialize the timer if it has not already been initialized
-    timer16_Sequence_t timer = SERVO_INDEX_TO_TIMER(servoIndex);
-    if(isTimerActive(timer) == false)
-      initISR(timer);
-    servos[this->servoIndex].Pin.isActive = true;  // this must be set after the check for isTimerActive
-  }
-  return this->servoIndex ;
+  return attachGroup(pin, min, max, 0, ESC_PWM);   // servos use REFRESH_INTERVAL
 }
 
-void VarSpeedServo::detach()
+// returns true if the timer group of this servo can send the given refresh interval and protocol,
+// which every channel of a group shares: no other channel is attached with different ones, and
+// fewer than channels others are attached
+bool VarSpeedServo::groupFits(unsigned int refresh, uint8_t protocol, uint8_t channels)
 {
-  servos[this->servoIndex].Pin.isActive = false;
   timer16_Sequence_t timer = SERVO_INDEX_TO_TIMER(servoIndex);
-  if(isTimerActive(timer) == false) {
-    finISR(timer);
+  if(engine->ppmPin[timer])
+    return true;                                              // a PPM stream carries any channel
+  uint8_t others = 0;
+  for(uint8_t channel = 0; channel < SERVOS_PER_TIMER; channel++) {
+    uint8_t index = SERVO_INDEX(timer, channel);
+    if(index != this->servoIndex && engine->servos[index].Pin.isActive) {
+      if(engine->refresh[timer] != refresh || engine->protocol[timer] != protocol)
+        return false;
+      others++;
+    }
   }
+  return others < channels;
 }
 
-void VarSpeedServo::write(int value)
+// returns true if pin exists on the board, its port register is cached and Pin.nbr only holds pin numbers 0 to 63
+static bool validPin(int pin)
 {
+  if(pin < 0 || pin >= 64)
+    return false;
+#if defined(NUM_DIGITAL_PINS) && defined(NOT_A_PIN)
+  return pin < NUM_DIGITAL_PINS && digitalPinToPort(pin) != NOT_A_PIN;   // the port table ends at NUM_DIGITAL_PINS
+#else
+  return true;
+#endif
+}
 
-  byte channel = this->servoIndex;
-  servos[channel].value = value;
-
-  if(value < MIN_PULSE_WIDTH)
+// attaches the pin with the pulse range min to max, and sets the refresh interval and protocol of the timer group
+uint8_t VarSpeedServo::attachGroup(int pin, int min, int max, unsigned int refresh, uint8_t protocol)
+{
+  if(this->servoIndex >= MAX_SERVOS || validPin(pin) == false)
+    return INVALID_SERVO;
+  // the pulse must stay longer than the trim compensation, and short enough to fit the tick conversions
+  min = constrain(min, TRIM_DURATION + 1, PULSE_LIMIT);
+  max = constrain(max, TRIM_DURATION + 1, PULSE_LIMIT);
+  if(min >= max || groupFits(refresh, protocol, SERVOS_PER_TIMER) == false)
+    return INVALID_SERVO;
+
+  pinMode( pin, OUTPUT) ;                                     // set servo pin to output
+  digitalWrite( pin, LOW) ;                                   // also turns off analogWrite() PWM, which port writes wouldn't
+  timer16_Sequence_t timer = SERVO_INDEX_TO_TIMER(servoIndex);
+  servo_t *servo = &engine->servos[this->servoIndex];
+  uint8_t oldSREG = SREG;
+  cli();                                                      // the interrupt handler may be using the old pin
+  servo->Pin.nbr = pin;
+  servo->out = portOutputRegister(digitalPinToPort(pin));
+  servo->mask = digitalPinToBitMask(pin);
+  servo->minTicks = usToTicks(min - TRIM_DURATION);
+  servo->maxTicks = usToTicks(max - TRIM_DURATION);
+  // keep the position, a move and the filter history inside the new range
+  if(servo->ticks < servo->minTicks || servo->ticks >= servo->maxTicks) {
+    servo->ticks = constrain(servo->ticks, servo->minTicks, servo->maxTicks);
+    servo->fraction = 0;
+  }
+  servo->target = constrain(servo->target, servo->minTicks, servo->maxTicks);
+#if defined(VARSPEEDSERVO_FILTERS)
+  servo->history[0] = constrain(servo->history[0], servo->minTicks, servo->maxTicks);
+  servo->history[1] = constrain(servo->history[1], servo->minTicks, servo->maxTicks);
+#endif
+  if(engine->ppmPin[timer] == 0) {
+    engine->refresh[timer] = refresh;
+    engine->protocol[timer] = protocol;
+  }
+  SREG = oldSREG;
+  this->min = min;
+  this->max = max;
+  updateCurve();
+  // initialize the timer if it has not already been initialized, other engines are pulsed by their owner
+  if(engine == &ServoEngine && engine->isTimerActive(timer) == false)
+    initISR(timer);
+  servo->Pin.isActive = true;                                 // this must be set after the check for isTimerActive
+  return this->servoIndex ;
+}
+
+/*
+  attachEsc(pin, protocol) - Attach an ESC using the given pulse protocol.
+
+  The pulse range and the refresh interval are set from the protocol, the refresh interval applies
+  to every channel on the timer of this servo, so ESCs need a timer of their own: this fails while
+  servos or ESCs of another protocol are attached on the timer, and attach() fails on a timer with
+  ESCs attached. The timer is free again once every channel on it is detached.
+  The channels of a timer are pulsed one after the other and full throttle on all of them must fit
+  the refresh interval, so a timer takes 1 ESC_PWM, 1 OneShot125 or 2 OneShot42 ESCs. DShot frames
+  are sent from the timer interrupt with interrupts disabled, a timer takes at most 8 DShot150 or 6
+  DShot300 ESCs.
+  The pulse starts at minimum throttle, which is what ESCs need to see to arm.
+  Throttle is set with writeMicroseconds() in the range of the protocol, or with write(0-180).
+  DShot channels are sent as digital frames from the timer interrupt, the throttle range of
+  1000-2000 uS is encoded as motor stop and DShot throttle 49-2047.
+*/
+uint8_t VarSpeedServo::attachEsc(int pin, escProtocol_t protocol)
+{
+  if(this->servoIndex >= MAX_SERVOS || protocol > ESC_DSHOT300 || validPin(pin) == false)
+    return INVALID_SERVO;
+  unsigned int refresh = pgm_read_word(&EscProtocols[protocol].refresh);
+  if(groupFits(refresh, protocol, pgm_read_byte(&EscProtocols[protocol].channels)) == false)
+    return INVALID_SERVO;
+
+  this->min = pgm_read_word(&EscProtocols[protocol].min);
+  this->max = pgm_read_word(&EscProtocols[protocol].max);
+  updateCurve();
+  this->writeMicroseconds(this->min);          // never start at DEFAULT_PULSE_WIDTH, that's a throttle setting
+  return attachGroup(pin, this->min, this->max, refresh, protocol);
+}
+
+/*
+  escCalibrate(ms) - Teach an ESC the throttle range of its protocol.
+
+  Sends full throttle for ms milliseconds, the ESC should be powered up during that time and
+  will signal that it has seen the maximum, then minimum throttle is sent to complete the calibration.
+  Blocks until done. DShot sends digital throttle values and needs no calibration, full throttle
+  would spin the motor, so on a DShot channel this does nothing.
+*/
+void VarSpeedServo::escCalibrate(unsigned int ms)
+{
+  if(this->servoIndex >= MAX_SERVOS || engine->protocol[SERVO_INDEX_TO_TIMER(servoIndex)] >= ESC_DSHOT150)
+    return;
+  this->writeMicroseconds(SERVO_MAX());
+  engine->pause(ms);
+  this->writeMicroseconds(SERVO_MIN());
+}
+
+/*
+  attachPpm(pin) - Send this servo as a channel of a PPM stream.
+
+  Every servo on the timer of this servo becomes a channel of the stream, in the order the objects
+  were created, and only the PPM pin is pulsed. Slow moves, sequences and everything else work as usual,
+  the pulse width of a servo is the length of its channel. A pulse in progress on a servo pin of the
+  timer is ended, the stream never pulls those pins low again.
+*/
+uint8_t VarSpeedServo::attachPpm(int pin)
+{
+  if(this->attach(pin) == INVALID_SERVO)
+    return INVALID_SERVO;
+  timer16_Sequence_t timer = SERVO_INDEX_TO_TIMER(servoIndex);
+  uint8_t oldSREG = SREG;
+  cli();
+  for(uint8_t channel = 0; channel < SERVOS_PER_TIMER; channel++) {
+    servo_t *servo = &engine->servos[SERVO_INDEX(timer, channel)];
+    if(servo->Pin.isActive)
+      pinLow(servo);
+  }
+  engine->refresh[timer] = PPM_FRAME_INTERVAL;
+  engine->ppmPin[timer] = pin + 1;
+  SREG = oldSREG;
+  return this->servoIndex;
+}
+
+/*
+  follow(inputChannel) - Route an RC receiver channel to this servo.
+
+  At every frame the servo is set to the last pulse width received on the input channel, limited
+  to the range given to attach, so a new input value goes out with the next pulse of the servo.
+  Writes to the servo are overridden while it follows an input, NO_INPUT ends following.
+*/
+void VarSpeedServo::follow(uint8_t inputChannel)
+{
+  if(this->servoIndex >= MAX_SERVOS)
+    return;
+#if defined(VARSPEEDSERVO_MIX)
+  mix(inputChannel, MIX_UNITY);
+#else
+  servo_t *servo = &engine->servos[this->servoIndex];
+  uint8_t oldSREG = SREG;
+  cli();
+  servo->input = inputChannel < MAX_INPUT_CHANNELS ? inputChannel + 1 : 0;
+  engine->markDirty(this->servoIndex);
+  SREG = oldSREG;
+  this->lastWrite = this->lastMicroseconds = NO_WRITE;   // a write after following has to be done again
+#endif
+}
+
+/*
+  mix(inputA,weightA,inputB,weightB) - Set this servo from two input channels.
+
+  At every frame the deviations of the input channels from the center pulse are multiplied by
+  their weights, where MIX_UNITY is 100% and negative weights reverse, added to the center and
+  limited to the range given to attach. The second channel is optional and is left out while it
+  has not received anything. Writes to the servo are overridden while it mixes, NO_INPUT as
+  inputA ends mixing. Mixing is only compiled with VARSPEEDSERVO_MIX defined, otherwise this does
+  nothing.
+*/
+void VarSpeedServo::mix(uint8_t inputA, int8_t weightA, uint8_t inputB, int8_t weightB)
+{
+#if defined(VARSPEEDSERVO_MIX)
+  if(this->servoIndex >= MAX_SERVOS)
+    return;
+  servo_t *servo = &engine->servos[this->servoIndex];
+  uint8_t oldSREG = SREG;
+  cli();
+  servo->input = inputA < MAX_INPUT_CHANNELS ? inputA + 1 : 0;
+  servo->weight = weightA;
+  servo->mixInput = inputB < MAX_INPUT_CHANNELS ? inputB + 1 : 0;
+  servo->mixWeight = weightB;
+  engine->markDirty(this->servoIndex);
+  SREG = oldSREG;
+  this->lastWrite = this->lastMicroseconds = NO_WRITE;   // a write after following has to be done again
+#endif
+}
+
+/*
+  beginCapture(mode) - Decode an RC receiver on the Timer1 input capture pin.
+
+  CAPTURE_PWM measures a single servo pulse into input channel 0, CAPTURE_PPM splits a PPM stream
+  into input channels 0 to 15. Edges are timestamped by the hardware, so the resolution is one tick
+  regardless of other interrupts. Timer1 is started if no servo uses it yet and must keep its
+  prescaler of 8. The capture interrupt is only compiled with VARSPEEDSERVO_INPUT_CAPTURE defined,
+  otherwise and on boards without a Timer1 input capture interrupt this does nothing.
+*/
+void VarSpeedServo::beginCapture(uint8_t mode)
+{
+#if defined(_useCapture1)
+  if(ServoEngine.isTimerActive(_timer1) == false && CaptureMode == 0)
+    initISR(_timer1);
+  uint8_t oldSREG = SREG;
+  cli();
+  CaptureMode = mode;
+  CaptureChannel = MAX_INPUT_CHANNELS;    // wait for a sync gap
+  TCCR1B |= _BV(ICNC1) | _BV(ICES1);      // noise canceler on, capture rising edges
+  TIFR1 = _BV(ICF1);                      // clear any pending capture
+  if(mode)
+    TIMSK1 |= _BV(ICIE1);
+  else
+    TIMSK1 &= ~_BV(ICIE1);
+  SREG = oldSREG;
+#endif
+}
+
+/*
+  followAnalog(analogPin, deadband) - Set this servo from an analog input without work in loop().
+
+  The ADC converts the pin once per refresh frame of this servo, started by the timer interrupt,
+  and the ADC interrupt sets the servo from the sample, 0 to 1023 giving the range given to attach
+  (call this after attach).
+  A change of deadband ADC counts or less is ignored. Only one servo can follow the ADC, a new call
+  replaces the previous one, and analogRead() changes the ADC setup so it can't be used meanwhile.
+  Following an analog pin ends following an input channel. NO_INPUT as analogPin stops.
+  The ADC interrupt handler is only compiled with VARSPEEDSERVO_ANALOG_INPUT defined, otherwise
+  this does nothing.
+*/
+void VarSpeedServo::followAnalog(uint8_t analogPin, uint8_t deadband)
+{
+#if defined(_useAnalog)
+  if(this->servoIndex >= MAX_SERVOS)
+    return;
+  uint8_t oldSREG = SREG;
+  cli();
+  if(analogPin == NO_INPUT) {
+    if(AnalogEngine == engine && AnalogServo == this->servoIndex + 1) {
+      AnalogServo = 0;
+      ADCSRA &= ~_BV(ADIE);
+    }
+  }
+  else {
+    if(analogPin >= A0)
+      analogPin -= A0;                        // allow for channel or pin numbers like analogRead
+#if defined(analogPinToChannel)
+    analogPin = analogPinToChannel(analogPin);
+#endif
+#if defined(MUX5)
+    ADCSRB = (ADCSRB & ~_BV(MUX5)) | (((analogPin >> 3) & 0x01) << MUX5);
+#endif
+    ADMUX = _BV(REFS0) | (analogPin & 0x07);  // AVcc reference, the DEFAULT of analogRead
+    // enable with the prescaler of analogRead, clear a pending result
+    ADCSRA = _BV(ADEN) | _BV(ADIF) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+    servo_t *servo = &engine->servos[this->servoIndex];
+    servo->input = 0;
+    this->lastWrite = this->lastMicroseconds = NO_WRITE;
+    AnalogLast = 0x8000;                      // the first sample is always used
+    AnalogDeadband = deadband;
+    AnalogMinTicks = servo->minTicks;
+    AnalogSpanTicks = servo->maxTicks - servo->minTicks;
+    AnalogEngine = engine;
+    AnalogTimer = SERVO_INDEX_TO_TIMER(servoIndex);
+    AnalogServo = this->servoIndex + 1;
+  }
+  SREG = oldSREG;
+#endif
+}
+
+/*
+  beginSerialInput(protocol) - Receive a serial RC receiver.
+
+  SERIAL_SBUS is 100000 baud 8E2 with an inverted signal (use an inverter), SERIAL_IBUS is 115200 baud 8N1.
+  With VARSPEEDSERVO_SERIAL_INPUT defined the UART receive interrupt decodes the packets, otherwise
+  this only sets the protocol and every received byte has to be passed to serialInput().
+*/
+void VarSpeedServo::beginSerialInput(uint8_t protocol)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  SerialProtocol = protocol;
+  SerialIndex = 0;
+#if defined(VARSPEEDSERVO_SERIAL_INPUT)
+  SERIAL_INPUT_UCSRA = _BV(SERIAL_INPUT_U2X);
+  if(protocol == SERIAL_SBUS) {
+    SERIAL_INPUT_UBRR = F_CPU / 8 / 100000 - 1;
+    SERIAL_INPUT_UCSRC = _BV(SERIAL_INPUT_UPM1) | _BV(SERIAL_INPUT_USBS) | _BV(SERIAL_INPUT_UCSZ1) | _BV(SERIAL_INPUT_UCSZ0);   // 8E2
+  }
+  else {
+    SERIAL_INPUT_UBRR = F_CPU / 8 / 115200 - 1;
+    SERIAL_INPUT_UCSRC = _BV(SERIAL_INPUT_UCSZ1) | _BV(SERIAL_INPUT_UCSZ0);    // 8N1
+  }
+  SERIAL_INPUT_UCSRB = protocol ? _BV(SERIAL_INPUT_RXEN) | _BV(SERIAL_INPUT_RXCIE) : 0;
+#endif
+  SREG = oldSREG;
+}
+
+// copies the channels of a complete packet to the input channels
+static void commitSerialInput(uint8_t count)
+{
+  unsigned int now = INPUT_CLOCK();
+  uint8_t oldSREG = SREG;
+  cli();                    // serialInput() may be called from loop(), servos must see whole packets and values
+  for(uint8_t channel = 0; channel < count; channel++) {
+    InputTicks[channel] = SerialPending[channel];
+    InputStamp[channel] = now;
+  }
+  InputFresh |= count >= 16 ? 0xFFFF : _BV(count) - 1;
+  SREG = oldSREG;
+}
+
+/*
+  serialInput(data) - Decode one byte of an SBUS or iBUS packet.
+
+  Channels are converted to ticks as the bytes arrive, so little work is left when the packet
+  completes. Packets with a bad header, footer or checksum and SBUS failsafe packets are dropped,
+  the input channels keep their last values. SBUS has no checksum, a byte more than 3 mS after the
+  previous one starts over at the header, so a packet missing bytes isn't completed with the next.
+  Called from the UART interrupt, or from the sketch for bytes read with Serial; interrupts must
+  not be disabled for long in that case, and SBUS bytes must be passed within 3 mS of each other.
+*/
+void VarSpeedServo::serialInput(uint8_t data)
+{
+  uint8_t index = SerialIndex++;
+
+  if(SerialProtocol == SERIAL_SBUS) {
+    unsigned long now = micros();
+    if(now - SerialTime > SBUS_GAP) {
+      index = 0;                      // the rest of the last packet was lost, this byte may start the next
+      SerialIndex = 1;
+    }
+    SerialTime = now;
+    if(index == 0) {
+      if(data != SBUS_HEADER)
+        SerialIndex = 0;              // wait for the start of a packet
+      SerialChannel = 0;
+      SerialBits = 0;
+      SerialBuffer = 0;
+    }
+    else if(index < SBUS_PACKET_SIZE - 2) {
+      // channels are packed 11 bits each, least significant bit first
+      SerialBuffer |= (uint32_t)data << SerialBits;
+      SerialBits += 8;
+      if(SerialBits >= 11) {
+        unsigned int value = SerialBuffer & 0x07FF;
+        SerialBuffer >>= 11;
+        SerialBits -= 11;
+        SerialPending[SerialChannel++] = usToTicks((value * 5UL >> 3) + 880);   // 172-1811 is 988-2012 uS
+      }
+    }
+    else if(index == SBUS_PACKET_SIZE - 2) {
+      if(data & SBUS_FAILSAFE)
+        SerialChannel = 0;            // don't commit failsafe values
+    }
+    else {
+      if(data == 0x00 || (data & 0xCF) == 0x04) {  // SBUS footer, and SBUS2 footers 0x04, 0x14, 0x24 and 0x34
+        if(SerialChannel == SBUS_CHANNELS)
+          commitSerialInput(SBUS_CHANNELS);
+      }
+      SerialIndex = 0;
+    }
+  }
+  else if(SerialProtocol == SERIAL_IBUS) {
+    if(index == 0) {
+      if(data != IBUS_PACKET_SIZE)
+        SerialIndex = 0;              // the first byte is the packet length
+      SerialChecksum = 0xFFFF - data;
+      SerialChannel = 0;
+    }
+    else if(index == 1) {
+      if(data != 0x40)                // servo channel command
+        SerialIndex = 0;
+      SerialChecksum -= data;
+    }
+    else if(index < IBUS_PACKET_SIZE - 2) {
+      SerialChecksum -= data;
+      if(index & 1) {
+        unsigned int value = (data << 8) | (uint8_t)SerialBuffer;
+        SerialPending[SerialChannel++] = usToTicks(value & 0x0FFF);
+      }
+      else {
+        SerialBuffer = data;
+      }
+    }
+    else if(index == IBUS_PACKET_SIZE - 2) {
+      SerialBuffer = data;
+    }
+    else {
+      if(SerialChecksum == (unsigned int)((data << 8) | (uint8_t)SerialBuffer))
+        commitSerialInput(IBUS_CHANNELS);
+      SerialIndex = 0;
+    }
+  }
+  else {
+    SerialIndex = 0;
+  }
+}
+
+int VarSpeedServo::readInput(uint8_t inputChannel)
+{
+  if(inputChannel >= MAX_INPUT_CHANNELS)
+    return 0;
+  uint8_t oldSREG = SREG;
+  cli();
+  unsigned int ticks = InputTicks[inputChannel];
+  SREG = oldSREG;
+  return ticks ? ticksToUs(ticks) : 0;
+}
+
+unsigned int VarSpeedServo::inputLatency()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  unsigned int ticks = InputLatency;
+  SREG = oldSREG;
+  return ticksToUs(ticks);
+}
+
+void VarSpeedServo::detach()
+{
+  if(this->servoIndex >= MAX_SERVOS)   // nothing to detach for an invalid servo
+    return;
+  engine->servos[this->servoIndex].Pin.isActive = false;
+  timer16_Sequence_t timer = SERVO_INDEX_TO_TIMER(servoIndex);
+  if(engine->isTimerActive(timer) == false) {
+    // the next channel attached chooses the refresh interval, protocol and output of the timer again
+    uint8_t oldSREG = SREG;
+    cli();
+    if(engine->ppmPin[timer]) {
+      digitalWrite(engine->ppmPin[timer] - 1, LOW);
+      engine->ppmPin[timer] = 0;
+      engine->ppmMarker[timer] = false;
+    }
+    engine->refresh[timer] = 0;
+    engine->protocol[timer] = ESC_PWM;
+    SREG = oldSREG;
+    if(engine == &ServoEngine)
+      finISR(timer);
+  }
+}
+
+/*
+  write(value) - Set the servo to an angle or a pulse width in microseconds.
+  writeMicroseconds(value) - Set the servo to a pulse width in microseconds.
+
+  Writing the same value as the last call returns right away, without converting it or
+  disabling interrupts, so control loops can write every iteration. Every other call that
+  changes the servo forgets the last value, so it is always set again after them, as are
+  stopAll() and setTicks(), which change the servo without its object.
+*/
+void VarSpeedServo::write(int value)
+{
+  if(value == this->lastWrite && !(this->servoIndex < MAX_SERVOS && retargeted(&engine->servos[this->servoIndex])))
+    return;
+  int written = value;
+  if(value < MIN_PULSE_WIDTH)
   {  // treat values less than 544 as angles in degrees (valid values in microseconds are handled as microseconds)
     // updated to use constrain() instead of if(), pva
     value = constrain(value, 0, 180);
-    value = map(value, 0, 180, SERVO_MIN(),  SERVO_MAX());
+    value = angleToUs(value);
   }
   this->writeMicroseconds(value);
+  this->lastWrite = written;
 }
 
 void VarSpeedServo::writeMicroseconds(int value)
 {
   // calculate and store the values for the given channel
   byte channel = this->servoIndex;
-  servos[channel].value = value;
 
-  if( (channel >= 0) && (channel < MAX_SERVOS) )   // ensure channel is valid
+  // ensure channel is valid, skip unchanged values unless the servo was changed without this object since
+  if( channel < MAX_SERVOS && (value != this->lastMicroseconds || retargeted(&engine->servos[channel])) )
   {
+    this->lastWrite = NO_WRITE;
+    this->lastMicroseconds = value;
     if( value < SERVO_MIN() )          // ensure pulse width is valid
       value = SERVO_MIN();
     else if( value > SERVO_MAX() )
       value = SERVO_MAX();
+    engine->servos[channel].value = value;
 
   	value -= TRIM_DURATION;
     value = usToTicks(value);  // convert to ticks after compensating for interrupt overhead - 12 Aug 2009
 
     uint8_t oldSREG = SREG;
     cli();
-    servos[channel].ticks = value;
+    if(FILTER_OF(&engine->servos[channel])) {
+      engine->servos[channel].target = value;   // the interrupt handler filters its way there
+      engine->markDirty(channel);
+    }
+    else {
+      engine->servos[channel].ticks = value;
+      engine->servos[channel].fraction = 0;
+    }
+    engine->servos[channel].velocity = 0;
+    engine->servos[channel].retargeted = false;
     SREG = oldSREG;
 
 	// Extension for slowmove
 	// Disable slowmove logic.
-	servos[channel].speed = 0;
+	engine->servos[channel].speed = 0;
 	// End of Extension for slowmove
   }
 }
 
+/*
+  writeMicrosecondsFine(value, fraction) - Like writeMicroseconds with fraction/256 uS added.
+
+  The pulse width is converted to ticks with 8 fractional bits. Without dithering the fraction
+  is dropped when the pulse is sent, see setDither().
+*/
+void VarSpeedServo::writeMicrosecondsFine(int value, uint8_t fraction)
+{
+  byte channel = this->servoIndex;
+
+  if( channel < MAX_SERVOS )   // ensure channel is valid
+  {
+    if( value < SERVO_MIN() ) {        // ensure pulse width is valid
+      value = SERVO_MIN();
+      fraction = 0;
+    }
+    else if( value >= SERVO_MAX() ) {
+      value = SERVO_MAX();
+      fraction = 0;
+    }
+    engine->servos[channel].value = value;
+
+    // convert to 1/256 ticks after compensating for interrupt overhead
+    unsigned long position = usToTicks(((unsigned long)(value - TRIM_DURATION) << 8) + fraction);
+
+    uint8_t oldSREG = SREG;
+    cli();
+    if(FILTER_OF(&engine->servos[channel])) {
+      engine->servos[channel].target = position >> 8;   // filters work in whole ticks
+      engine->markDirty(channel);
+    }
+    else {
+      engine->servos[channel].ticks = position >> 8;
+      engine->servos[channel].fraction = position;
+    }
+    engine->servos[channel].velocity = 0;
+    engine->servos[channel].speed = 0;
+    SREG = oldSREG;
+    this->lastWrite = this->lastMicroseconds = NO_WRITE;
+  }
+}
+
+/*
+  setDither(on) - Deliver fractional pulse widths on average.
+
+  The timer resolution is one tick (0.5 uS at 16 MHz). With dithering on, each frame the
+  fractional part of the position is added to an accumulator and the pulse is one tick longer
+  whenever it overflows, so the pulse alternates between adjacent ticks and averages to the
+  position from writeMicrosecondsFine() or an intermediate position of a slow move.
+  Meant for digital servos that average over several frames.
+*/
+void VarSpeedServo::setDither(bool on)
+{
+  if(this->servoIndex < MAX_SERVOS)
+    engine->servos[this->servoIndex].Pin.dither = on;
+}
+
+/*
+  setFilter(filter) - Smooth the positions written to this servo.
+
+  Writes set the position the filter works towards, the interrupt handler updates the pulse once
+  per frame. FILTER_EMA(shift) moves 1/2^shift of the remaining distance each frame, with the
+  fraction kept between frames, and takes the last tick at once. FILTER_MEDIAN sends the median of the
+  positions written in the last three frames, a value written for one frame only is dropped.
+  Slow moves and stop() are not filtered. FILTER_NONE sends writes unchanged again.
+  Filters are only compiled with VARSPEEDSERVO_FILTERS defined, otherwise this does nothing.
+*/
+void VarSpeedServo::setFilter(uint8_t filter)
+{
+#if defined(VARSPEEDSERVO_FILTERS)
+  if(this->servoIndex >= MAX_SERVOS)
+    return;
+  servo_t *servo = &engine->servos[this->servoIndex];
+  uint8_t oldSREG = SREG;
+  cli();
+  if(servo->speed == 0)
+    servo->target = servo->ticks;     // start from the current position
+  servo->history[0] = servo->ticks;
+  servo->history[1] = servo->ticks;
+  servo->filter = filter > FILTER_MEDIAN ? FILTER_MEDIAN : filter;
+  engine->markDirty(this->servoIndex);
+  SREG = oldSREG;
+  this->lastWrite = this->lastMicroseconds = NO_WRITE;
+#endif
+}
+
+/*
+  setReverse(reversed) - Reverse the direction of angles.
+  setTrim(microseconds) - Shift the center of angles.
+  setExpo(percent) - Soften angles near the center.
+
+  These shape the conversion from angles to pulse widths, the way an RC transmitter does. The curve
+  is computed once here into a table of pulse widths every 22.5 degrees, write(angle) interpolates
+  in it, so a shaped write costs no more than a plain one. Expo blends the linear curve with a cubic
+  one, at 100% the servo moves a sixteenth as far per degree within 22.5 degrees of the center. The
+  trim shifts the whole curve, the ends are still limited to the range given to attach. Pulse widths
+  written in microseconds are not shaped, they already are the pulse sent to the servo. read()
+  returns the angle whose pulse width is nearest, the lowest one where several angles share it.
+  The curve is only compiled with VARSPEEDSERVO_CURVES defined, otherwise angles map linearly to
+  the range given to attach and these do nothing.
+*/
+void VarSpeedServo::setReverse(bool reversed)
+{
+#if defined(VARSPEEDSERVO_CURVES)
+  this->reversed = reversed;
+  updateCurve();
+#endif
+}
+
+void VarSpeedServo::setTrim(int microseconds)
+{
+#if defined(VARSPEEDSERVO_CURVES)
+  this->trim = microseconds;
+  updateCurve();
+#endif
+}
+
+void VarSpeedServo::setExpo(uint8_t percent)
+{
+#if defined(VARSPEEDSERVO_CURVES)
+  this->expo = percent > 100 ? 100 : percent;
+  updateCurve();
+#endif
+}
+
+void VarSpeedServo::updateCurve()
+{
+  this->lastWrite = this->lastMicroseconds = NO_WRITE;     // the same angle may give a different pulse now
+#if defined(VARSPEEDSERVO_CURVES)
+  const int segments = CURVE_POINTS - 1;
+  long half = (long)(SERVO_MAX() - SERVO_MIN()) / 2;
+  long center = (long)(SERVO_MIN() + SERVO_MAX()) / 2 + this->trim;
+  for(int8_t i = 0; i < CURVE_POINTS; i++) {
+    // position from -1 to 1 as x/4, shaped as x*(1-expo) + x^3*expo in units of 1/(4*16*100)
+    long x = reversed ? segments / 2 - i : i - segments / 2;
+    long y = x * (100 - this->expo) * 16 + x * x * x * this->expo;
+    long value = center + y * half / 6400;
+    this->curve[i] = constrain(value, SERVO_MIN(), SERVO_MAX());
+  }
+#endif
+}
+
+int VarSpeedServo::angleToUs(int value)
+{
+#if !defined(VARSPEEDSERVO_CURVES)
+  return map(value, 0, 180, SERVO_MIN(), SERVO_MAX());
+#else
+  // the table has a point every 45 half degrees
+  unsigned int halfDegrees = value * 2;
+  if(value >= 180)
+    return this->curve[CURVE_POINTS - 1];
+  uint8_t segment = halfDegrees / 45;
+  uint8_t offset = halfDegrees - segment * 45;
+  int start = this->curve[segment];
+  return start + (long)(this->curve[segment + 1] - start) * offset / 45;
+#endif
+}
+
+int VarSpeedServo::usToAngle(int value)
+{
+  // the inverse of angleToUs(), which rises or falls monotonically: the lowest angle at or past
+  // value, or if the angle below is as near the lowest angle sending that pulse width, so flat
+  // parts of the curve always give the same angle
+#if defined(VARSPEEDSERVO_CURVES)
+  int sign = this->curve[CURVE_POINTS - 1] >= this->curve[0] ? 1 : -1;
+#else
+  const int sign = 1;
+#endif
+  uint8_t angle = angleReaching(value, sign);
+  if(angle == 0)
+    return 0;
+  int below = angleToUs(angle - 1);
+  if(angle <= 180 && sign * (angleToUs(angle) - value) < sign * (value - below))
+    return angle;
+  return angleReaching(below, sign);
+}
+
+// returns the lowest angle that angleToUs() gives value or more for, less if sign is -1, 181 if none
+uint8_t VarSpeedServo::angleReaching(int value, int sign)
+{
+#if !defined(VARSPEEDSERVO_CURVES)
+  // map() rises from SERVO_MIN() to SERVO_MAX() rounded down, its inverse is rounded up
+  if(value <= SERVO_MIN())
+    return 0;
+  if(value > SERVO_MAX())
+    return 181;
+  long span = SERVO_MAX() - SERVO_MIN();
+  return ((long)(value - SERVO_MIN()) * 180 + span - 1) / span;
+#else
+  if(sign * (this->curve[0] - value) >= 0)
+    return 0;
+  uint8_t segment = 0;                    // the first segment of the curve that reaches value
+  while(sign * (this->curve[segment + 1] - value) < 0) {
+    if(++segment == CURVE_POINTS - 1)
+      return 181;
+  }
+  // inside the segment angleToUs() is start + rise * offset / 45 rounded towards start, so the first
+  // offset in half degrees reaching value is the inverse rounded up, and the angle its half rounded up
+  int rise = sign * (this->curve[segment + 1] - this->curve[segment]);
+  long needed = sign * (value - this->curve[segment]);
+  unsigned int halfDegrees = segment * 45 + (needed * 45 + rise - 1) / rise;
+  return (halfDegrees + 1) / 2;
+#endif
+}
+
 // Extension for slowmove
 /*
   write(value, speed) - Just like write but at reduced speed.
@@ -394,61 +1988,242 @@ void VarSpeedServo::writeMicroseconds(int value)
           speed=255 - Maximum speed
 */
 void VarSpeedServo::write(int value, uint8_t speed) {
-	// This fuction is a copy of write and writeMicroseconds but value will be saved
-	// in target instead of in ticks in the servo structure and speed will be save
-	// there too.
-
-  byte channel = this->servoIndex;
-  servos[channel].value = value;
-
 	if (speed) {
 
 		if (value < MIN_PULSE_WIDTH) {
 			// treat values less than 544 as angles in degrees (valid values in microseconds are handled as microseconds)
 			// updated to use constrain instead of if, pva
 			value = constrain(value, 0, 180);
-			value = map(value, 0, 180, SERVO_MIN(),  SERVO_MAX());
-		}
-
-		// calculate and store the values for the given channel
-		if( (channel >= 0) && (channel < MAX_SERVOS) ) {   // ensure channel is valid
-			// updated to use constrain instead of if, pva
-			value = constrain(value, SERVO_MIN(), SERVO_MAX());
-
-			value = value - TRIM_DURATION;
-			value = usToTicks(value);  // convert to ticks after compensating for interrupt overhead - 12 Aug 2009
-
-			// Set speed and direction
-			uint8_t oldSREG = SREG;
-			cli();
-			servos[channel].target = value;
-			servos[channel].speed = speed;
-			SREG = oldSREG;
+			value = angleToUs(value);
 		}
+		moveMicroseconds(value, (unsigned int)speed << 8);
 	}
 	else {
 		write (value);
 	}
 }
 
+/*
+  writeAtRate(value, degreesPerSecond) - Like write(value, speed) with the speed in degrees per second.
+  writeMicrosecondsAtRate(value, microsecondsPerSecond) - The same with the speed in microseconds per second.
+
+  The rate is converted once to a fixed point step per refresh frame, so the real speed stays the
+  same when the refresh interval or the clock changes and shorter frames give smoother moves.
+  The conversion assumes the pulses on a timer fit in the refresh interval, which holds for up to 8 servos
+  at the longest pulse width. A rate of 0 is full speed, identical to write.
+*/
+void VarSpeedServo::writeAtRate(int value, unsigned int degreesPerSecond) {
+  if (value < MIN_PULSE_WIDTH) {
+    // treat values less than 544 as angles in degrees (valid values in microseconds are handled as microseconds)
+    value = constrain(value, 0, 180);
+    value = angleToUs(value);
+  }
+  unsigned long rate = (unsigned long)degreesPerSecond * abs(SERVO_MAX() - SERVO_MIN()) / 180;
+  if (rate == 0 && degreesPerSecond != 0)
+    rate = 1;
+  writeMicrosecondsAtRate(value, rate > 0xFFFF ? 0xFFFF : rate);
+}
+
+void VarSpeedServo::writeMicrosecondsAtRate(int value, unsigned int microsecondsPerSecond) {
+  if (this->servoIndex >= MAX_SERVOS)   // an invalid servo has no timer to take the refresh interval of
+    return;
+  if (microsecondsPerSecond == 0) {
+    writeMicroseconds(value);
+    return;
+  }
+  unsigned long step = usPerSecondToStep(microsecondsPerSecond, engine->refreshInterval(SERVO_INDEX_TO_TIMER(servoIndex)));
+  if (step == 0)
+    step = 1;            // slowest possible move rather than no move at all
+  else if (step > 0xFFFF)
+    step = 0xFFFF;
+  moveMicroseconds(value, step);
+}
+
+void VarSpeedServo::setAcceleration(unsigned int degreesPerSecondSquared) {
+  unsigned long acceleration = (unsigned long)degreesPerSecondSquared * abs(SERVO_MAX() - SERVO_MIN()) / 180;
+  if (acceleration == 0 && degreesPerSecondSquared != 0)
+    acceleration = 1;
+  setAccelerationMicroseconds(acceleration > 0xFFFF ? 0xFFFF : acceleration);
+}
+
+/*
+  setAccelerationMicroseconds(microsecondsPerSecondSquared) - Ramp the speed of moves at the given rate.
+
+  The acceleration is converted once to a change of the per frame step, like the rates of writeAtRate.
+  Moves speed up to the requested speed and slow down to stop on the target. A new target written
+  during a move starts from the current velocity instead of from zero, so targets can be streamed
+  at a high rate without jerks. 0 disables the ramp.
+*/
+void VarSpeedServo::setAccelerationMicroseconds(unsigned int microsecondsPerSecondSquared) {
+  byte channel = this->servoIndex;
+  if (channel >= MAX_SERVOS)
+    return;
+
+  unsigned int interval = engine->refreshInterval(SERVO_INDEX_TO_TIMER(channel));
+  // the change of the step per frame is the step for the rate times the frame in seconds, with the
+  // multiplication split so the full input range can't overflow
+  unsigned long step = usPerSecondToStep(microsecondsPerSecondSquared, interval);
+  unsigned long acceleration = ((step / 1000) * interval + (step % 1000) * interval / 1000) / 1000;
+  if (acceleration == 0 && microsecondsPerSecondSquared != 0)
+    acceleration = 1;
+  else if (acceleration > 0xFFFF)
+    acceleration = 0xFFFF;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  engine->servos[channel].acceleration = acceleration;
+  SREG = oldSREG;
+}
+
+void VarSpeedServo::moveMicroseconds(int value, unsigned int step) {
+	// This function is a copy of writeMicroseconds but value will be saved
+	// in target instead of in ticks in the servo structure and step will be saved
+	// as the speed there too.
+	byte channel = this->servoIndex;
+
+	// calculate and store the values for the given channel
+	if( channel < MAX_SERVOS ) {   // ensure channel is valid
+		// updated to use constrain instead of if, pva
+		value = constrain(value, SERVO_MIN(), SERVO_MAX());
+		engine->servos[channel].value = value;
+
+		value = value - TRIM_DURATION;
+		value = usToTicks(value);  // convert to ticks after compensating for interrupt overhead - 12 Aug 2009
+
+		// Set speed and direction
+		uint8_t oldSREG = SREG;
+		cli();
+		engine->servos[channel].target = value;
+		engine->servos[channel].speed = step;
+		engine->markDirty(channel);
+		SREG = oldSREG;
+		this->lastWrite = this->lastMicroseconds = NO_WRITE;
+	}
+}
+
 void VarSpeedServo::write(int value, uint8_t speed, bool wait) {
   write(value, speed);
 
   if (wait) { // block until the servo is at its new position
-    if (value < MIN_PULSE_WIDTH) {
-      while (read() != value) {
-        delay(5);
-      }
-    } else {
-      while (readMicroseconds() != value) {
-        delay(5);
-      }
-    }
+    this->wait();
   }
 }
 
+/*
+  stop() - Stop the servo at its current position.
+
+  Without acceleration the servo freezes at the exact pulse width it was sent in the last frame.
+  With acceleration a moving servo decelerates to a stop instead, the target is set to the point
+  where braking from the current velocity ends. Following an input channel, a mix or an analog
+  pin ends.
+*/
 void VarSpeedServo::stop() {
-  write(read());
+  byte channel = this->servoIndex;
+  if (channel >= MAX_SERVOS)
+    return;
+
+  this->lastWrite = this->lastMicroseconds = NO_WRITE;
+  servo_t *servo = &engine->servos[channel];
+  uint8_t oldSREG = SREG;
+  for (;;) {
+    // the braking distance takes a long division, it is computed with interrupts enabled and
+    // computed again if the interrupt handler moved a servo meanwhile (as in snapshot)
+    cli();
+    unfollow(engine, channel, servo);
+    uint8_t sequence = engine->updates;
+    long accel = servo->acceleration;
+    if (accel == 0 || servo->speed == 0 || servo->velocity == 0) {
+      freeze(servo);
+      break;
+    }
+    long velocity = servo->velocity;
+    long position = ((long)servo->ticks << 8) | servo->fraction;
+    long from = position;
+    unsigned int target = servo->target;
+    SREG = oldSREG;
+
+    unsigned long braking = brakingDistance(velocity < 0 ? -velocity : velocity, accel);
+    if (velocity > 0)
+      position += braking + 255;       // round towards the direction of travel so the stop is never abrupt
+    else
+      position -= braking;
+    position = constrain(position, (long)servo->minTicks << 8, (long)servo->maxTicks << 8);   // or at the limits
+    // never past the target it was heading for, compared in 1/256 ticks: a servo on the tick of
+    // its target with a fraction left still has to move down to it
+    if (velocity > 0) {
+      if (((long)target << 8) <= from || (position >> 8) < target)
+        target = position >> 8;
+    }
+    else {
+      if (((long)target << 8) >= from || (position >> 8) > target)
+        target = position >> 8;
+    }
+
+    cli();
+    if (sequence == engine->updates) {
+      servo->target = target;
+      break;
+    }
+    SREG = oldSREG;
+  }
+  SREG = oldSREG;
+}
+
+/*
+  stopAll() - Emergency stop for every servo.
+
+  Sets a flag per timer that the interrupt handler checks once per refresh frame, every servo is
+  frozen at its current pulse width within one frame and stops following its input channel, mix
+  or analog pin. Sequences continue if sequencePlay() is
+  called again, use sequenceStop() on each servo to end them. VarSpeedServo::stopAll() stops
+  the servos of ServoEngine.
+*/
+void ServoController::stopAll() {
+  uint8_t oldSREG = SREG;
+  cli();
+  *(volatile uint8_t *)&stopRequest = _BV(_Nbr_16timers) - 1;   // stored before interrupts are enabled again
+  SREG = oldSREG;
+}
+
+void VarSpeedServo::stopAll() {
+  ServoEngine.stopAll();
+}
+
+/*
+  snapshot(states, count) - Copy the state of several servos as one consistent pose.
+
+  Fills states with the first count servos in the order the objects were created and returns the
+  number of servos copied. The raw values are copied with interrupts enabled and the copy is taken
+  again if a servo interrupt changed a servo meanwhile (a sequence lock), so the pose is from a single
+  instant without delaying the servo pulses. The conversion to microseconds happens afterwards.
+  VarSpeedServo::snapshot() copies the servos of ServoEngine.
+*/
+uint8_t ServoController::snapshot(servoSnapshot states[], uint8_t count) {
+  if (count > servoCount)
+    count = servoCount;
+
+  volatile uint8_t *updated = &updates;       // read again on every pass
+  uint8_t sequence;
+  do {
+    sequence = *updated;
+    for (uint8_t i = 0; i < count; i++) {
+      volatile servo_t *servo = &servos[i];    // read again on every pass
+      bool moving = servo->speed != 0;
+      states[i].position = servo->ticks;
+      states[i].target = (moving || FILTER_OF(servo)) ? servo->target : servo->ticks;
+      states[i].moving = moving;
+    }
+  } while (sequence != *updated);
+
+  for (uint8_t i = 0; i < count; i++) {
+    states[i].position = ticksToUs(states[i].position) + TRIM_DURATION;
+    states[i].target = ticksToUs(states[i].target) + TRIM_DURATION;
+  }
+  return count;
+}
+
+uint8_t VarSpeedServo::snapshot(servoSnapshot states[], uint8_t count) {
+  return ServoEngine.snapshot(states, count);
 }
 
 void VarSpeedServo::slowmove(int value, uint8_t speed) {
@@ -461,14 +2236,19 @@ void VarSpeedServo::slowmove(int value, uint8_t speed) {
 
 int VarSpeedServo::read() // return the value as degrees
 {
-  return  map( this->readMicroseconds()+1, SERVO_MIN(), SERVO_MAX(), 0, 180);
+  return usToAngle(this->readMicroseconds());
 }
 
 int VarSpeedServo::readMicroseconds()
 {
   unsigned int pulsewidth;
-  if( this->servoIndex != INVALID_SERVO )
-    pulsewidth = ticksToUs(servos[this->servoIndex].ticks)  + TRIM_DURATION ;   // 12 aug 2009
+  if( this->servoIndex != INVALID_SERVO ) {
+    uint8_t oldSREG = SREG;
+    cli();
+    unsigned int ticks = engine->servos[this->servoIndex].ticks;    // the interrupt handler updates it during moves
+    SREG = oldSREG;
+    pulsewidth = ticksToUs(ticks)  + TRIM_DURATION ;   // 12 aug 2009
+  }
   else
     pulsewidth  = 0;
 
@@ -477,10 +2257,19 @@ int VarSpeedServo::readMicroseconds()
 
 bool VarSpeedServo::attached()
 {
-  return servos[this->servoIndex].Pin.isActive ;
+  if(this->servoIndex >= MAX_SERVOS)
+    return false;
+  return engine->servos[this->servoIndex].Pin.isActive ;
 }
 
 uint8_t VarSpeedServo::sequencePlay(servoSequencePoint sequenceIn[], uint8_t numPositions, bool loop, uint8_t startPos) {
+  if (numPositions == 0 || numPositions == CURRENT_SEQUENCE_STOP) { // nothing to play, and 255 positions can't be told apart from a stopped sequence
+    return CURRENT_SEQUENCE_STOP;
+  }
+  if (startPos >= numPositions) {
+    startPos = 0;
+  }
+
   uint8_t oldSeqPosition = this->curSeqPosition;
 
   if( this->curSequence != sequenceIn) {
@@ -489,8 +2278,19 @@ uint8_t VarSpeedServo::sequencePlay(servoSequencePoint sequenceIn[], uint8_t num
     this->curSeqPosition = startPos;
     oldSeqPosition = 255;
   }
+  else if (this->curSeqPosition >= numPositions && this->curSeqPosition != CURRENT_SEQUENCE_STOP) {
+    // same sequence played with fewer positions than before
+    this->curSeqPosition = startPos;
+  }
 
-  if (read() == sequenceIn[this->curSeqPosition].position && this->curSeqPosition != CURRENT_SEQUENCE_STOP) {
+  // the position is reached once the pulse width reads back as written for it, not by read(), as
+  // several angles may share a pulse width
+  unsigned int reached = 0;
+  if (this->curSeqPosition != CURRENT_SEQUENCE_STOP) {
+    int value = angleToUs(constrain(sequenceIn[this->curSeqPosition].position, 0, 180));
+    reached = ticksToUs(usToTicks(value - TRIM_DURATION)) + TRIM_DURATION;
+  }
+  if (reached != 0 && (unsigned int)readMicroseconds() == reached) {
     this->curSeqPosition++;
 
     if (this->curSeqPosition >= numPositions) { // at the end of the loop
@@ -517,53 +2317,73 @@ uint8_t VarSpeedServo::sequencePlay(servoSequencePoint sequenceIn[], uint8_t num
 }
 
 void VarSpeedServo::sequenceStop() {
-  write(read());
+  stop();
   this->curSeqPosition = CURRENT_SEQUENCE_STOP;
 }
 
 // to be used only with "write(value, speed)"
 void VarSpeedServo::wait() {
-  byte channel = this->servoIndex;
-  int value = servos[channel].value;
-
   // wait until is done
-  if (value < MIN_PULSE_WIDTH) {
-    while (read() != value) {
-      delay(5);
-    }
-  } else {
-    while (readMicroseconds() != value) {
-      delay(5);
-    }
+  while (isMoving()) {
+    engine->pause(5);
   }
 }
 
 bool VarSpeedServo::isMoving() {
   byte channel = this->servoIndex;
-  int value = servos[channel].value;
+  if (channel >= MAX_SERVOS) {
+    return false;
+  }
+  // the interrupt handler clears speed once ticks has reached the target,
+  // comparing the clamped tick values can't hang on a lossy or out of range value
+  return engine->servos[channel].speed != 0;
+}
 
+unsigned long VarSpeedServo::estimateMoveTime(int value, uint8_t speed) {
+  byte channel = this->servoIndex;
+  if (channel >= MAX_SERVOS || speed == 0) {
+    return 0;
+  }
+
+  // convert value the same way write(value, speed) does
   if (value < MIN_PULSE_WIDTH) {
-    if (read() != value) {
-      return true;
-    }
-  } else {
-    if (readMicroseconds() != value) {
-      return true;
-    }
+    value = constrain(value, 0, 180);
+    value = angleToUs(value);
   }
-  return false;
+  value = constrain(value, SERVO_MIN(), SERVO_MAX());
+
+  uint8_t oldSREG = SREG;
+  cli();
+  servo_t servo = engine->servos[channel];
+  SREG = oldSREG;
+  servo.target = usToTicks(value - TRIM_DURATION);   // as moveMicroseconds() sets it, keeping the velocity
+  servo.speed = (unsigned int)speed << 8;
+  return moveTime(servo, engine->refreshInterval(SERVO_INDEX_TO_TIMER(channel)));
+}
+
+unsigned long VarSpeedServo::moveTimeRemaining() {
+  byte channel = this->servoIndex;
+  if (channel >= MAX_SERVOS) {
+    return 0;
+  }
+
+  uint8_t oldSREG = SREG;
+  cli();
+  servo_t servo = engine->servos[channel];
+  SREG = oldSREG;
+  return moveTime(servo, engine->refreshInterval(SERVO_INDEX_TO_TIMER(channel)));
 }
 
 /*
 	To do
 int VarSpeedServo::targetPosition() {
 	byte channel = this->servoIndex;
-	return map( servos[channel].target+1, SERVO_MIN(), SERVO_MAX(), 0, 180);
+	return map( engine->servos[channel].target+1, SERVO_MIN(), SERVO_MAX(), 0, 180);
 }
 
 int VarSpeedServo::targetPositionMicroseconds() {
 	byte channel = this->servoIndex;
-	return servos[channel].target;
+	return engine->servos[channel].target;
 }
 
 */
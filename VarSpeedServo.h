@@ -49,12 +49,34 @@
    attach(pin )  - Attaches a servo motor to an i/o pin.
    attach(pin, min, max  ) - Attaches to a pin setting min and max values in microseconds
    default min is 544, max is 2400
+   attachEsc(pin, protocol) - Attaches an ESC using ESC_PWM, ESC_ONESHOT125, ESC_ONESHOT42, ESC_DSHOT150 or ESC_DSHOT300 at minimum throttle
+   escCalibrate(ms) - Sends full throttle for ms milliseconds, then minimum throttle, does nothing on DShot
+   attachPpm(pin) - Sends this servo as the next channel of a PPM stream on pin instead of pulsing a pin of its own
+
+   setFilter(filter) - smooth written pulse widths at every frame, FILTER_EMA(shift), FILTER_MEDIAN or FILTER_NONE, with VARSPEEDSERVO_FILTERS
+   setReverse(reversed) - reverse the direction of angles written to this servo, with VARSPEEDSERVO_CURVES
+   setTrim(microseconds) - shift the center of angles written to this servo by the given pulse width, with VARSPEEDSERVO_CURVES
+   setExpo(percent) - soften angles near the center with an exponential curve, 0 (default) to 100%, with VARSPEEDSERVO_CURVES
+   VarSpeedServo::beginCapture(mode) - decode an RC receiver on the Timer1 input capture pin, CAPTURE_PWM or CAPTURE_PPM
+   VarSpeedServo::readInput(channel) - last pulse width in microseconds received on an input channel, 0 if none yet
+   VarSpeedServo::inputLatency() - microseconds from the end of the last routed input pulse to the start of the servo pulse
+   follow(channel) - route an input channel to this servo at the next frame, NO_INPUT to stop
+   mix(inputA,weightA,inputB,weightB) - set this servo from a weighted sum of two input channels at every frame, MIX_UNITY is 100%, with VARSPEEDSERVO_MIX
+   followAnalog(pin,deadband) - set this servo from an analog pin sampled once per frame by the ADC interrupt, NO_INPUT to stop
+   VarSpeedServo::beginSerialInput(protocol) - receive SERIAL_SBUS or SERIAL_IBUS in the UART interrupt into the input channels
+   VarSpeedServo::serialInput(byte) - feed one received SBUS/iBUS byte to the decoder, when the UART is read elsewhere
 
    write(value)     - Sets the servo angle in degrees.  (invalid angle that is valid as pulse in microseconds is treated as microseconds)
    write(value, speed) - speed varies the speed of the move to new position 0=full speed, 1-255 slower to faster
    write(value, speed, wait) - wait is a boolean that, if true, causes the function call to block until move is complete
+   writeAtRate(value, degreesPerSecond) - as write(value, speed) with the speed given in degrees per second
+   writeMicrosecondsAtRate(value, microsecondsPerSecond) - as write(value, speed) with the speed given in microseconds per second
+   setAcceleration(degreesPerSecondSquared) - accelerate and decelerate moves, new targets keep the current velocity
+   setAccelerationMicroseconds(microsecondsPerSecondSquared) - as setAcceleration() in microseconds per second per second
 
    writeMicroseconds() - Sets the servo pulse width in microseconds
+   writeMicrosecondsFine(value, fraction) - Sets the pulse width in microseconds plus fraction/256 microseconds
+   setDither(on) - alternate the pulse between adjacent timer ticks to deliver the average of fractional widths
    read()      - Gets the last written servo pulse width as an angle between 0 and 180.
    readMicroseconds()  - Gets the last written servo pulse width in microseconds. (was read_us() in first release)
    attached()  - Returns true if there is a servo attached.
@@ -62,12 +84,22 @@
 
    slowmove(value, speed) - The same as write(value, speed), retained for compatibility with Korman's version
 
-   stop() - stops the servo at the current position
+   stop() - stops the servo at the current position, decelerating if an acceleration is set, and ends following inputs
+   stopAll() - emergency stop, halts every servo within one refresh frame and ends following inputs
+   snapshot(states, count) - copies position, target and moving flag of every servo as one consistent pose
+
+   VarSpeedServo(controller) - a servo of another ServoController than ServoEngine, pulsed by the owner of that engine
+   ServoController::handleInterrupt(timer, count, compare) - run an engine from a timer other than the servo timers
+   ServoController::edgeDelay() - worst delay in microseconds of a pulse edge since the last call
+   ServoController::service() - pulse the servos of an engine from loop() or a shared interrupt, without a timer
 
    sequencePlay(sequence, sequencePositions); // play a looping sequence starting at position 0
    sequencePlay(sequence, sequencePositions, loop, startPosition); // play sequence with number of positions, loop if true, start at position
    sequenceStop(); // stop sequence at current position
 
+   estimateMoveTime(value, speed); // milliseconds a write(value, speed) would take from the current position
+   moveTimeRemaining(); // milliseconds until the current move completes
+
  */
 
 #ifndef VarSpeedServo_h
@@ -84,8 +116,20 @@
  *
  */
 
+// Uncomment to pulse the first 12 servos with the 8 bit Timer2 where there is one, so Timer1 stays free
+// for input capture and other libraries. PWM on the Timer2 pins and tone() can't be used then.
+//#define VARSPEEDSERVO_TIMER2
+
 // Say which 16 bit timers can be used and in what order
-#if defined(__AVR_ATmega1280__)  || defined(__AVR_ATmega2560__)
+#if (defined(__AVR_ATmega1280__)  || defined(__AVR_ATmega2560__)) && defined(VARSPEEDSERVO_TIMER2) && !defined(WIRING)
+#define _useTimer2
+#define _useTimer5
+#define _useTimer1
+#define _useTimer3
+#define _useTimer4
+typedef enum { _timer2, _timer5, _timer1, _timer3, _timer4, _Nbr_16timers } timer16_Sequence_t ;
+
+#elif defined(__AVR_ATmega1280__)  || defined(__AVR_ATmega2560__)
 #define _useTimer5
 #define _useTimer1
 #define _useTimer3
@@ -107,6 +151,11 @@ typedef enum { _timer3, _timer1, _Nbr_16timers } timer16_Sequence_t ;
 #define _useTimer1
 typedef enum { _timer3, _timer1, _Nbr_16timers } timer16_Sequence_t ;
 
+#elif defined(VARSPEEDSERVO_TIMER2) && !defined(__AVR_ATmega8__) && !defined(WIRING)
+#define _useTimer2                    // Timer2 counts 8 bits, extended to 16 bits by its overflow interrupt
+#define _useTimer1
+typedef enum { _timer2, _timer1, _Nbr_16timers } timer16_Sequence_t ;
+
 #else  // everything else
 #define _useTimer1
 typedef enum { _timer1, _Nbr_16timers } timer16_Sequence_t ;
@@ -124,12 +173,73 @@ typedef enum { _timer1, _Nbr_16timers } timer16_Sequence_t ;
 
 #define INVALID_SERVO         255     // flag indicating an invalid servo index
 
+#define PPM_FRAME_INTERVAL  22500     // length of a PPM frame in microseconds
+#define PPM_MARKER_WIDTH      300     // pulse starting each PPM channel in microseconds
+#define PPM_MIN_SYNC         4000     // minimum gap after the last PPM channel in microseconds
+
+#define MAX_INPUT_CHANNELS     16     // number of RC receiver channels that are decoded
+#define CURVE_POINTS            9     // points of the angle to pulse width table, every 22.5 degrees
+
+#define FILTER_NONE             0     // setFilter() modes, unfiltered is the default
+#define FILTER_EMA(shift)  (shift)    // exponential moving average, 1/2^shift of the error per frame, shift 1 to 7
+#define FILTER_MEDIAN           8     // median of the positions written in the last three frames
+
+#define NO_INPUT              255     // follow() value to stop following an input channel
+#define MIX_UNITY              64     // mix() weight of 100%, weights are fixed point with 6 fraction bits
+#define CAPTURE_PWM             1     // beginCapture() mode decoding a single servo pulse into input channel 0
+#define CAPTURE_PPM             2     // beginCapture() mode decoding a PPM stream
+#define CAPTURE_PPM_SYNC     3000     // a gap in microseconds longer than this starts a new PPM frame
+
+#define SERIAL_SBUS             1     // serial receiver protocols for beginSerialInput() and serialInput()
+#define SERIAL_IBUS             2
+
+// Uncomment to pulse the servo pins with digitalWrite() instead of cached port writes in the timer interrupt,
+// for cores where port registers of a pin can't be written directly.
+//#define VARSPEEDSERVO_DIGITALWRITE
+
+// Uncomment to run the slow move and filter math of the timer interrupt with interrupts enabled, after the pulse
+// has started, so other interrupt handlers aren't held off by it. Servo pulses are timed as before.
+// Not with VARSPEEDSERVO_TIMER2.
+//#define VARSPEEDSERVO_NESTED_INTERRUPTS
+
+// Uncomment to decode RC receivers with beginCapture(), which needs the Timer1 input capture interrupt.
+//#define VARSPEEDSERVO_INPUT_CAPTURE
+
+// Uncomment to follow an analog pin with followAnalog(), which needs the ADC conversion complete interrupt.
+//#define VARSPEEDSERVO_ANALOG_INPUT
+
+// Uncomment to receive SBUS/iBUS in the UART receive interrupt of Serial1 (or Serial on boards without one).
+// The interrupt conflicts with using that port through the Serial object.
+//#define VARSPEEDSERVO_SERIAL_INPUT
+
+// Uncomment to shape angles with setReverse(), setTrim() and setExpo(), the curve takes 22 bytes of RAM in every
+// servo object. Without it angles map linearly to the range given to attach and those calls do nothing.
+//#define VARSPEEDSERVO_CURVES
+
+// Uncomment to smooth writes with setFilter(), the filter state takes 5 bytes of RAM per servo channel
+// (MAX_SERVOS of them). Without it setFilter() does nothing.
+//#define VARSPEEDSERVO_FILTERS
+
+// Uncomment to set servos from two weighted input channels with mix(), the weights and the second channel take
+// 3 bytes of RAM per servo channel (MAX_SERVOS of them). Without it mix() does nothing, follow() still works.
+//#define VARSPEEDSERVO_MIX
+
 #define CURRENT_SEQUENCE_STOP   255    // used to indicate the current sequence is not used and sequence should stop
 
+// ESC pulse protocols, the refresh interval applies to all channels on the same timer
+typedef enum {
+  ESC_PWM,                            // 1000-2000 uS pulses at 400 Hz, 1 ESC per timer
+  ESC_ONESHOT125,                     // 125-250 uS pulses at 2 kHz, 1 ESC per timer
+  ESC_ONESHOT42,                      // 42-84 uS pulses at 4 kHz, 2 ESCs per timer
+  ESC_DSHOT150,                       // digital 16 bit frames at 150 kbit/s and 1 kHz, throttle written as 1000-2000 uS, 8 ESCs per timer
+  ESC_DSHOT300                        // as above at 300 kbit/s and 2 kHz, 6 ESCs per timer
+} escProtocol_t;
+
 
 typedef struct  {
   uint8_t nbr        :6 ;             // a pin number from 0 to 63
   uint8_t isActive   :1 ;             // true if this channel is enabled, pin not pulsed if false
+  uint8_t dither     :1 ;             // true to dither the pulse between adjacent ticks for sub-tick resolution
 } ServoPin_t   ;
 
 typedef struct {
@@ -137,7 +247,26 @@ typedef struct {
   unsigned int ticks;
 	unsigned int value;			// Extension for external wait (Gill)
 	unsigned int target;			// Extension for slowmove
-	uint8_t speed;					// Extension for slowmove
+	unsigned int speed;				// Extension for slowmove, ticks per refresh frame in 1/256 ticks (0 if not moving)
+	uint8_t fraction;				// fractional part of ticks in 1/256 ticks
+	uint8_t ditherError;			// sigma-delta accumulator of the fraction, a carry adds one tick to the pulse
+	int velocity;					// current speed of a move in 1/256 ticks per frame, negative when ticks decrease
+	unsigned int acceleration;		// speed change per frame in 1/256 ticks per frame, 0 to start and stop at full speed
+	unsigned int minTicks;			// pulse width limits in ticks, set by attach
+	unsigned int maxTicks;
+	volatile uint8_t *out;			// output register and bit mask of the pin, set by attach for the interrupt handler
+	uint8_t mask;
+	uint8_t input;					// input channel + 1 routed to this servo, 0 if none
+#if defined(VARSPEEDSERVO_MIX)
+	uint8_t mixInput;				// second input channel + 1 mixed into this servo, 0 if none
+	int8_t weight;					// weights of the input channels, MIX_UNITY is 100%
+	int8_t mixWeight;
+#endif
+#if defined(VARSPEEDSERVO_FILTERS)
+	uint8_t filter;					// FILTER_NONE, FILTER_EMA(shift) or FILTER_MEDIAN, a filtered write sets target
+	unsigned int history[2];		// target in ticks of the last two frames for FILTER_MEDIAN
+#endif
+	bool retargeted;				// set when stopAll() or setTicks() changed the servo, its next write is never skipped
 } servo_t;
 
 typedef struct {
@@ -145,12 +274,100 @@ typedef struct {
   uint8_t speed;
 } servoSequencePoint;
 
+typedef struct {
+  int position;                      // pulse width in uS being sent
+  int target;                        // pulse width in uS the servo is moving or filtering to, position if neither
+  bool moving;                       // true during a slow move
+} servoSnapshot;
+
+/*
+  ServoController - the channel table and timer state of one servo engine.
+
+  ServoEngine is the engine driven by the hardware timer interrupts and is used by VarSpeedServo
+  objects created without an engine. Further engines can be created for servos pulsed by other
+  means, their handleInterrupt() is called with the count and compare registers of the timer
+  (real or emulated) driving them, so an engine can also be run without any hardware.
+  The constructor zeroes every member and is constexpr, so global engines are initialized
+  before the constructors of the servo objects using them run; engines may also be local or
+  allocated, as long as they outlive their servos. A constexpr constructor needs members that
+  aren't volatile, those shared with the interrupt handlers are read through volatile pointers.
+*/
+class ServoController
+{
+public:
+  constexpr ServoController() : servos{}, channel{}, servoCount(0), stopRequest(0), updates(0), lateTicks(0),
+    refresh{}, protocol{}, ppmPin{}, ppmMarker{}, ppmSlotEnd{}, frameStart{}, dirty{}, compare{}, compareSet{}, polled(0),
+    servicing(false)
+#if defined(VARSPEEDSERVO_NESTED_INTERRUPTS)
+    , updating{}, deferredTicks{}
+#endif
+  {}
+  void handleInterrupt(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA); // end the current pulse and start the next
+  void setTicks(uint8_t index, unsigned int ticks); // set a servo from an interrupt handler, filtered servos take it as their target
+  void stopAll();                    // freeze every servo of this engine within one refresh frame
+  uint8_t snapshot(servoSnapshot states[], uint8_t count); // copy the state of the first count servos at one instant
+  uint8_t count();                   // number of servo objects using this engine
+  unsigned int edgeDelay();          // worst uS a pulse edge was late since the last call
+  void service();                    // pulse the servos of an engine without a timer, call as often as possible
+private:
+  friend class VarSpeedServo;
+  void markDirty(uint8_t index);
+  void checkStopRequest(timer16_Sequence_t timer);
+  unsigned int refreshInterval(timer16_Sequence_t timer);
+  unsigned int ticksToRefresh(timer16_Sequence_t timer, unsigned int now, unsigned int minimum);
+  void updateServo(timer16_Sequence_t timer, servo_t *servo);
+#if defined(VARSPEEDSERVO_NESTED_INTERRUPTS)
+  void updateServoNested(timer16_Sequence_t timer, servo_t *servo);
+#endif
+  void handlePpm(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA);
+  void handleEdge(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA);
+  friend void servoInterrupt(timer16_Sequence_t timer, volatile uint16_t *TCNTn, volatile uint16_t *OCRnA);
+  bool isTimerActive(timer16_Sequence_t timer);
+  void pause(unsigned long ms);
+
+  servo_t servos[MAX_SERVOS];                 // channel data, indexed by servo index
+  int8_t channel[_Nbr_16timers];              // servo being pulsed for each timer, -1 during the rest of the refresh interval
+  uint8_t servoCount;                         // number of servo indexes handed out
+  uint8_t stopRequest;                        // bit per timer, set by stopAll() to freeze all servos on that timer
+  uint8_t updates;                            // incremented by interrupt handlers that change servos, for snapshot()
+  unsigned int lateTicks;                     // worst ticks the interrupt handler started after the compare match
+  unsigned int refresh[_Nbr_16timers];        // refresh interval in uS for each timer, 0 for REFRESH_INTERVAL
+  uint8_t protocol[_Nbr_16timers];            // escProtocol_t of the ESCs on each timer, only DShot changes the output
+  uint8_t ppmPin[_Nbr_16timers];              // PPM output pin + 1 for each timer, 0 if the timer pulses servo pins
+  bool ppmMarker[_Nbr_16timers];              // true while the pulse starting a PPM channel is high
+  unsigned int ppmSlotEnd[_Nbr_16timers];     // timer count at which the current PPM channel ends
+  unsigned int frameStart[_Nbr_16timers];     // timer count at which the current refresh frame started
+  uint16_t dirty[_Nbr_16timers];              // bit per channel of each timer with work to do at every frame
+  uint16_t compare[_Nbr_16timers];            // compare match in ticks of each timer run by service()
+  uint16_t compareSet[_Nbr_16timers];         // count at which it was set
+  uint8_t polled;                             // bit per timer run by service()
+  bool servicing;                             // true while service() runs, so it can't nest in itself
+#if defined(VARSPEEDSERVO_NESTED_INTERRUPTS)
+  uint8_t updating[_Nbr_16timers];            // servo index + 1 updated with interrupts enabled on each timer, 0 if none
+  unsigned int deferredTicks[_Nbr_16timers];  // ticks set by setTicks() meanwhile, 0 if none
+#endif
+};
+
+extern ServoController ServoEngine;          // the engine run by the timer interrupts
+
 class VarSpeedServo
 {
 public:
   VarSpeedServo();
+  VarSpeedServo(ServoController &controller); // a servo of another engine than ServoEngine
   uint8_t attach(int pin);           // attach the given pin to the next free channel, sets pinMode, returns channel number or 0 if failure
-  uint8_t attach(int pin, int min, int max); // as above but also sets min and max values for writes.
+  uint8_t attach(int pin, int min, int max); // as above but also sets min and max values for writes, fails if min >= max
+  uint8_t attachEsc(int pin, escProtocol_t protocol); // attach an ESC, starts at minimum throttle so it can arm
+  void escCalibrate(unsigned int ms); // full throttle for ms milliseconds (power the ESC meanwhile), then minimum throttle, not for DShot
+  uint8_t attachPpm(int pin);        // send this servo as a channel of the PPM stream on pin
+  void follow(uint8_t inputChannel); // set this servo from an input channel at every frame, NO_INPUT to stop
+  void mix(uint8_t inputA, int8_t weightA, uint8_t inputB = NO_INPUT, int8_t weightB = 0); // set this servo from weighted input channels at every frame (VARSPEEDSERVO_MIX)
+  static void beginCapture(uint8_t mode); // decode CAPTURE_PWM or CAPTURE_PPM on the Timer1 input capture pin
+  static int readInput(uint8_t inputChannel); // last pulse width in uS on the input channel, 0 if none received
+  static unsigned int inputLatency(); // uS from the end of the last routed input pulse to the servo pulse using it
+  void followAnalog(uint8_t analogPin, uint8_t deadband = 2); // set this servo from an analog pin at every frame, NO_INPUT to stop
+  static void beginSerialInput(uint8_t protocol); // decode SERIAL_SBUS or SERIAL_IBUS from the UART interrupt
+  static void serialInput(uint8_t data); // decode one SBUS/iBUS byte read elsewhere, the protocol is set by beginSerialInput
   void detach();
   void write(int value);             // if value is < 544 its treated as an angle, otherwise as pulse width in microseconds
   void write(int value, uint8_t speed); // Move to given position at reduced speed.
@@ -158,9 +375,21 @@ public:
           // On the RC-Servos tested, speeds differences above 127 can't be noticed,
           // because of the mechanical limits of the servo.
   void write(int value, uint8_t speed, bool wait); // wait parameter causes call to block until move completes
+  void writeAtRate(int value, unsigned int degreesPerSecond); // Move to given position at a speed in degrees per second, 0 is full speed
+  void writeMicrosecondsAtRate(int value, unsigned int microsecondsPerSecond); // Move to given pulse width at a speed in uS per second, 0 is full speed
+  void setAcceleration(unsigned int degreesPerSecondSquared); // ramp the speed of moves up and down, 0 (default) moves at constant speed
+  void setAccelerationMicroseconds(unsigned int microsecondsPerSecondSquared); // as above in uS per second per second
   void writeMicroseconds(int value); // Write pulse width in microseconds
+  void writeMicrosecondsFine(int value, uint8_t fraction); // Write pulse width in microseconds plus fraction/256 uS
+  void setDither(bool on);           // dither pulses between adjacent ticks so fractional widths are delivered on average
+  void setFilter(uint8_t filter);    // smooth writes at every frame with FILTER_EMA(shift) or FILTER_MEDIAN, FILTER_NONE to stop (VARSPEEDSERVO_FILTERS)
+  void setReverse(bool reversed);    // reverse the direction of angles, 0 degrees gives the maximum pulse width (VARSPEEDSERVO_CURVES)
+  void setTrim(int microseconds);    // shift the center of angles by the given pulse width, the limits of attach still apply (VARSPEEDSERVO_CURVES)
+  void setExpo(uint8_t percent);     // soften angles near the center, 0 (default) is linear and 100 fully cubic (VARSPEEDSERVO_CURVES)
   void slowmove(int value, uint8_t speed);
   void stop(); // stop the servo where it is
+  static void stopAll(); // stop all servos within one refresh frame
+  static uint8_t snapshot(servoSnapshot states[], uint8_t count); // copy the state of the first count servos at one instant, returns the number copied
 
   int read();                        // returns current pulse width as an angle between 0 and 180 degrees
   int readMicroseconds();            // returns current pulse width in microseconds for this servo (was read_us() in first release)
@@ -171,10 +400,28 @@ public:
   void sequenceStop(); // stop movement
   void wait(); // wait for movement to finish
   bool isMoving(); // return true if servo is still moving
+  unsigned long estimateMoveTime(int value, uint8_t speed); // milliseconds write(value, speed) would take from the current position
+  unsigned long moveTimeRemaining(); // milliseconds until the current move completes, 0 if not moving
 private:
+   void moveMicroseconds(int value, unsigned int step); // start a slow move to value uS, step in 1/256 ticks per frame
+   bool groupFits(unsigned int refresh, uint8_t protocol, uint8_t channels); // true if no other channel of the timer uses another refresh or protocol
+   uint8_t attachGroup(int pin, int min, int max, unsigned int refresh, uint8_t protocol); // attach and set the refresh and protocol of the timer
+   void updateCurve();               // recompute the angle table from the limits, reverse, trim and expo, forget the last write
+   int angleToUs(int value);         // convert an angle of 0 to 180 degrees to a pulse width in uS
+   int usToAngle(int value);         // convert a pulse width in uS back to an angle
+   uint8_t angleReaching(int value, int sign); // lowest angle whose pulse width reaches value, 181 if none
+   ServoController *engine;          // engine holding the channel data of this servo
    uint8_t servoIndex;               // index into the channel data for this servo
-   int8_t min;                       // minimum is this value times 4 added to MIN_PULSE_WIDTH
-   int8_t max;                       // maximum is this value times 4 added to MAX_PULSE_WIDTH
+   int min;                          // minimum pulse width in uS
+   int max;                          // maximum pulse width in uS
+#if defined(VARSPEEDSERVO_CURVES)
+   int curve[CURVE_POINTS];          // pulse width in uS at every 22.5 degrees, shaped by reverse, trim and expo
+   int trim;                         // center offset in uS
+   uint8_t expo;                     // expo in percent
+   bool reversed;
+#endif
+   int lastWrite;                    // value of the last write(), NO_WRITE after any other change
+   int lastMicroseconds;             // value of the last writeMicroseconds(), NO_WRITE after any other change
    servoSequencePoint * curSequence; // for sequences
    uint8_t curSeqPosition; // for sequences
 
@@ -0,0 +1,183 @@
+/*
+  Benchmark
+  Measures the average cost of the VarSpeedServo calls used in a control loop
+  This example code is in the public domain.
+
+  Each call is repeated ITERATIONS times and timed with micros(), the empty loop
+  overhead is subtracted and the result is printed in microseconds and CPU cycles per call.
+  The servo interrupt keeps running during the measurement, so the numbers include
+  its share of the CPU, just like they would in a real sketch.
+
+  Flash and static RAM use are printed by the IDE after compiling this sketch, or by
+  extras/test/run.sh, which also runs the sketch under simavr when it is installed;
+  the RAM used by each servo object and the free RAM are printed at startup.
+  Run the sketch once per library version to track the numbers over time.
+
+  The time spent in the servo interrupt is measured by counting how often a busy
+  loop runs in WINDOW milliseconds with the servo detached and attached.
+  The worst delay of a pulse edge is printed while idle and while printing to Serial,
+  whose interrupt competes with the servo interrupt.
+  Where there is a Timer2, its compare interrupt stands in for another interrupt of the
+  sketch, like an encoder's, and its worst delay is printed during a slow move. Define
+  VARSPEEDSERVO_NESTED_INTERRUPTS in VarSpeedServo.h to compare both ways of updating servos.
+  With VARSPEEDSERVO_TIMER2 the servo itself is on Timer2, which has no competing interrupt then.
+*/
+
+#include <VarSpeedServo.h>
+
+VarSpeedServo myservo;
+
+const int servoPin = 9;             // the digital pin used for the servo
+const unsigned int ITERATIONS = 1000;
+const unsigned long WINDOW = 100;   // milliseconds the busy loop runs to measure the interrupt
+
+servoSequencePoint sequence[] = {{0,20},{180,20}};
+
+volatile int sink;                  // keeps the compiler from optimizing results away
+unsigned long overhead;
+
+extern unsigned int __heap_start;
+extern void *__brkval;
+
+int freeRam() {
+  int v;
+  return (int) &v - (__brkval == 0 ? (int) &__heap_start : (int) __brkval);
+}
+
+void report(const char *name, unsigned long elapsed) {
+  if (elapsed > overhead) {
+    elapsed -= overhead;
+  } else {
+    elapsed = 0;
+  }
+  Serial.print(name);
+  Serial.print('\t');
+  Serial.print((float)elapsed / ITERATIONS, 2);
+  Serial.print(" us\t");
+  Serial.print(elapsed * clockCyclesPerMicrosecond() / ITERATIONS);
+  Serial.println(" cycles");
+}
+
+// counts the busy loop iterations in WINDOW milliseconds
+unsigned long busyLoop() {
+  unsigned long count = 0;
+  unsigned long start = millis();
+  while (millis() - start < WINDOW) {
+    count++;
+  }
+  return count;
+}
+
+// CPU cycles the servo interrupt takes per refresh frame, from how much it slows the busy loop
+void reportInterrupt() {
+  myservo.detach();
+  unsigned long idle = busyLoop();
+  myservo.attach(servoPin);
+  myservo.write(90);
+  unsigned long busy = busyLoop();
+  float lost = idle > busy ? (float)(idle - busy) / idle : 0;
+  Serial.print("interrupt per frame\t");
+  Serial.print(lost * clockCyclesPerMicrosecond() * REFRESH_INTERVAL, 0);
+  Serial.println(" cycles");
+}
+
+// worst delay of a pulse edge in WINDOW milliseconds, while printing if busy
+void reportEdgeDelay(bool busy) {
+  ServoEngine.edgeDelay();
+  unsigned long start = millis();
+  while (millis() - start < WINDOW) {
+    if (busy)
+      Serial.print('.');
+  }
+  unsigned int delay = ServoEngine.edgeDelay();
+  if (busy)
+    Serial.println();
+  Serial.print(busy ? "edge delay printing\t" : "edge delay idle\t");
+  Serial.print(delay);
+  Serial.println(" us");
+}
+
+#if defined(TCCR2A) && !defined(_useTimer2)
+volatile uint8_t timer2Late;        // worst Timer2 counts from the compare match to its interrupt
+
+ISR(TIMER2_COMPA_vect) {
+  uint8_t late = TCNT2;             // counts up from 0 at the compare match
+  if (late > timer2Late)
+    timer2Late = late;
+}
+
+// worst delay of the servo edges and of a competing interrupt in WINDOW milliseconds of an accelerated move
+void reportCompetingInterrupt() {
+  TCCR2A = _BV(WGM21);              // clear on compare match, prescaler 8, interrupt every 256 counts
+  TCCR2B = _BV(CS21);
+  OCR2A = 255;
+  TIMSK2 = _BV(OCIE2A);
+  myservo.setAcceleration(100);
+  myservo.write(0, 10);
+  ServoEngine.edgeDelay();
+  timer2Late = 0;
+  delay(WINDOW);
+  unsigned int edge = ServoEngine.edgeDelay();
+  TIMSK2 = 0;
+  myservo.stop();
+  myservo.setAcceleration(0);
+  Serial.print("edge delay moving\t");
+  Serial.print(edge);
+  Serial.println(" us");
+  Serial.print("other interrupt delay\t");
+  Serial.print(timer2Late * 8 / clockCyclesPerMicrosecond());
+  Serial.println(" us");
+}
+#endif
+
+// times ITERATIONS executions of the statement _call
+#define BENCH(_name, _call) do {                     \
+    unsigned long start = micros();                  \
+    for (unsigned int i = 0; i < ITERATIONS; i++) {  \
+      _call;                                         \
+    }                                                \
+    report(_name, micros() - start);                 \
+  } while (0)
+
+void setup() {
+  Serial.begin(115200);
+  myservo.attach(servoPin);
+
+  Serial.print("sizeof(VarSpeedServo)\t");
+  Serial.println(sizeof(VarSpeedServo));
+  Serial.print("free RAM\t");
+  Serial.println(freeRam());
+  Serial.print("pulse resolution\t");
+#if defined(_useTimer2)
+  Serial.print(32.0 / clockCyclesPerMicrosecond(), 1);   // the servo is on Timer2, prescaler 32
+#else
+  Serial.print(8.0 / clockCyclesPerMicrosecond(), 1);    // 16 bit timers, prescaler 8
+#endif
+  Serial.println(" us");
+
+  overhead = 0;
+  unsigned long start = micros();
+  for (unsigned int i = 0; i < ITERATIONS; i++) {
+    sink = i;
+  }
+  overhead = micros() - start;
+
+  BENCH("write(value)", myservo.write(i & 127));
+  BENCH("write(same value)", myservo.write(90));
+  BENCH("write(value,speed)", myservo.write(i & 127, 20));
+  BENCH("writeMicroseconds()", myservo.writeMicroseconds(1000 + (i & 511)));
+  BENCH("read()", sink = myservo.read());
+  BENCH("readMicroseconds()", sink = myservo.readMicroseconds());
+  BENCH("isMoving()", sink = myservo.isMoving());
+  BENCH("sequencePlay()", sink = myservo.sequencePlay(sequence, 2));
+  myservo.sequenceStop();
+  reportInterrupt();
+  reportEdgeDelay(false);
+  reportEdgeDelay(true);
+#if defined(TCCR2A) && !defined(_useTimer2)
+  reportCompetingInterrupt();
+#endif
+}
+
+void loop() {
+}
@@ -0,0 +1,28 @@
+/*
+  KnobFollow
+  Controlling a servo position using a potentiometer (variable resistor), without any code in loop()
+  This example code is in the public domain.
+
+  Does what the Knob example does, but the ADC is started by the servo interrupt once per refresh
+  frame and its own interrupt sets the servo, so loop() is free for other work.
+  The deadband ignores small changes of the reading, which keeps ADC noise from making the servo buzz.
+  Uncomment VARSPEEDSERVO_ANALOG_INPUT in VarSpeedServo.h first, otherwise followAnalog() does nothing.
+  Note that servos usually require more power than is available from the USB port - use an external power supply!
+*/
+
+#include <VarSpeedServo.h>
+
+VarSpeedServo myservo;    // create servo object to control a servo
+
+const int potPin = A0;    // analog pin used to connect the potentiometer
+const int servoPin = 9;   // the digital pin used for the servo
+const int deadband = 2;   // changes of the reading up to this are ignored
+
+void setup() {
+  myservo.attach(servoPin);             // attaches the servo on pin 9 to the servo object
+  myservo.followAnalog(potPin, deadband);  // the servo follows the potentiometer from now on
+}
+
+void loop() {
+  // nothing to do here, the servo is updated by interrupts
+}
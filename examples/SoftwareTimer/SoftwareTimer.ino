@@ -0,0 +1,42 @@
+/*
+  SoftwareTimer
+  Sweeps a servo without using a hardware timer
+  This example code is in the public domain.
+
+  The servo belongs to its own ServoController instead of ServoEngine, so no timer is set up for it,
+  and loop() pulses it by calling service() as often as it can. Slow moves and wait() work as usual.
+  Each pulse is too long by the time between two calls of service(), the worst case of the last
+  second is printed; keep other work in loop() short to keep it small.
+  Note that servos usually require more power than is available from the USB port - use an external power supply!
+*/
+
+#include <VarSpeedServo.h>
+
+ServoController softEngine;           // an engine pulsed from loop()
+VarSpeedServo myservo(softEngine);    // create servo object on that engine
+
+const int servoPin = 9;   // the digital pin used for the servo
+
+unsigned long lastReport;
+
+void setup() {
+  Serial.begin(115200);
+  myservo.attach(servoPin);           // no timer is started, the pin is pulsed by service()
+  softEngine.service();               // wait() keeps the engine running once service() was called
+  myservo.write(0, 255, true);        // move to the start position at full speed
+}
+
+void loop() {
+  softEngine.service();               // send the pulse edges that are due
+
+  if (!myservo.isMoving()) {
+    myservo.write(myservo.read() < 90 ? 180 : 0, 30);  // sweep at speed 30
+  }
+
+  if (millis() - lastReport >= 1000) {
+    lastReport = millis();
+    Serial.print("worst edge delay ");
+    Serial.print(softEngine.edgeDelay());  // worst since the last report
+    Serial.println(" us");
+  }
+}
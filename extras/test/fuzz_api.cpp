@@ -0,0 +1,191 @@
+/*
+  fuzz_api.cpp - libFuzzer target for the public API of VarSpeedServo.
+
+  Every input is a script: the first byte sets the number of servos calls go to, the rest is a
+  list of calls with their arguments taken from the following bytes, interleaved with timer
+  compare matches of an engine run from a virtual counter. Every channel of the engine is handed
+  out, and one more object gets INVALID_SERVO: it may be picked like the others, and every call
+  is also made on it with the same arguments, where it must do nothing. After every call the pulse
+  width of each attached servo must stay in the range attach() gave it and every compare match
+  must be set ahead of the count; the sanitizers catch out of bounds accesses and undefined
+  behavior. After the script, stopAll() must have ended every move within two refresh frames.
+
+  Built by run.sh with a replay driver (fuzz_main.cpp), or with clang for libFuzzer:
+    clang++ -g -fsanitize=fuzzer,address,undefined -Imock -I../.. fuzz_api.cpp mock/Arduino.cpp ../../VarSpeedServo.cpp
+*/
+
+#include <Arduino.h>
+#include <VarSpeedServo.h>
+#include <new>
+#include <stdio.h>
+
+static ServoController engine;                    // run from count and compare below, no hardware timer
+static volatile uint16_t count;
+static volatile uint16_t compare;
+
+#define INVALID MAX_SERVOS                        // the object created after every channel was handed out
+
+static unsigned char storage[MAX_SERVOS + 1][sizeof(VarSpeedServo)] __attribute__((aligned(8)));
+static VarSpeedServo *servos[MAX_SERVOS + 1];
+static uint8_t servoCount;
+static bool attached[MAX_SERVOS + 1];
+static int minimum[MAX_SERVOS + 1];               // pulse width range of each attached servo, found by writing past it
+static int maximum[MAX_SERVOS + 1];
+
+static servoSequencePoint sequence[] = {{0, 30}, {180, 60}, {90, 0}, {45, 255}};
+
+// reads the arguments of the script, zeros once it is used up
+struct Script {
+  const uint8_t *data;
+  size_t size;
+  uint8_t u8() { if (size == 0) return 0; size--; return *data++; }
+  int i16() { uint8_t low = u8(); return (int16_t)(low | (u8() << 8)); }
+  unsigned int u16() { return (uint16_t)i16(); }
+};
+
+static void fail(const char *what, int servo, int value)
+{
+  fprintf(stderr, "fuzz_api: %s (servo %d, value %d)\n", what, servo, value);
+  abort();
+}
+
+static void check()
+{
+  if (servos[INVALID]->attached() || servos[INVALID]->readMicroseconds() != 0 || servos[INVALID]->isMoving())
+    fail("invalid servo attached, pulsed or moving", INVALID, servos[INVALID]->readMicroseconds());
+  for (uint8_t i = 0; i < MAX_SERVOS; i++) {
+    if (!attached[i])
+      continue;
+    int us = servos[i]->readMicroseconds();
+    if (us < minimum[i] || us > maximum[i])
+      fail("pulse width outside the attach() range", i, us);
+  }
+}
+
+static void edge()
+{
+  count = compare;
+  engine.handleInterrupt((timer16_Sequence_t)0, &count, &compare);
+  if (compare == count)
+    fail("compare match not set ahead of the count", -1, compare);
+}
+
+// attaching sets the range, find it by writing past both ends
+static void probe(uint8_t i)
+{
+  VarSpeedServo *servo = servos[i];
+  servo->setFilter(FILTER_NONE);
+  servo->follow(NO_INPUT);
+  servo->writeMicroseconds(-32767);
+  minimum[i] = servo->readMicroseconds();
+  servo->writeMicroseconds(32767);
+  maximum[i] = servo->readMicroseconds();
+  if (minimum[i] >= maximum[i])
+    fail("attach() accepted an empty range", i, minimum[i]);
+}
+
+// makes call op on servo i with the arguments from the script
+static void call(uint8_t op, uint8_t i, Script &script)
+{
+  VarSpeedServo *servo = servos[i];
+  switch (op % 24) {
+    case 0: {
+      int pin = script.u8() % 24;                   // pins 20 to 23 don't exist on the mock board
+      int min = script.i16();
+      int max = script.i16();
+      attached[i] = servo->attach(pin, min, max) != INVALID_SERVO;
+      if (attached[i])
+        probe(i);
+      break;
+    }
+    case 1: {
+      attached[i] = servo->attachEsc(script.u8() % 24, (escProtocol_t)(script.u8() % 6)) != INVALID_SERVO;
+      if (attached[i])
+        probe(i);
+      break;
+    }
+    case 2:
+      attached[i] = servo->attachPpm(script.u8() % 24) != INVALID_SERVO;
+      if (attached[i])
+        probe(i);
+      break;
+    case 3: servo->write(script.i16()); break;
+    case 4: { int value = script.i16(); servo->write(value, script.u8()); break; }
+    case 5: servo->writeMicroseconds(script.i16()); break;
+    case 6: { int value = script.i16(); servo->writeMicrosecondsFine(value, script.u8()); break; }
+    case 7: { int value = script.i16(); servo->writeAtRate(value, script.u16()); break; }
+    case 8: { int value = script.i16(); servo->writeMicrosecondsAtRate(value, script.u16()); break; }
+    case 9: servo->setAcceleration(script.u16()); break;
+    case 10: servo->setAccelerationMicroseconds(script.u16()); break;
+    case 11: servo->stop(); break;
+    case 12: engine.stopAll(); break;
+    case 13: servo->setFilter(script.u8()); break;
+    case 14: servo->setReverse(script.u8() & 1); break;
+    case 15: servo->setTrim(script.i16()); break;
+    case 16: servo->setExpo(script.u8()); break;
+    case 17: servo->setDither(script.u8() & 1); break;
+    case 18: servo->detach(); attached[i] = false; break;
+    case 19: { uint8_t input = script.u8(); servo->mix(input, script.u8(), script.u8(), script.u8()); break; }
+    case 20: VarSpeedServo::serialInput(script.u8()); break;
+    case 21: servo->sequencePlay(sequence, script.u8() % 5, script.u8() & 1, script.u8()); break;
+    case 22: {
+      servoSnapshot states[MAX_SERVOS];
+      servo->read();
+      servo->isMoving();
+      servo->estimateMoveTime(script.i16(), script.u8());
+      servo->moveTimeRemaining();
+      engine.snapshot(states, script.u8());
+      break;
+    }
+    default:
+      for (uint8_t edges = 1 + script.u8() % 64; edges; edges--) {
+        edge();
+        check();
+      }
+      break;
+  }
+}
+
+// true for the calls of a servo, which are made on the invalid servo too
+static bool servoCall(uint8_t op)
+{
+  op %= 24;
+  return op != 12 && op != 20 && op < 23;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  Script script = { data, size };
+
+  engine = ServoController();
+  count = 0;
+  compare = 0;
+  VarSpeedServo::beginSerialInput(0);
+  servoCount = 1 + script.u8() % (MAX_SERVOS + 1);
+  for (uint8_t i = 0; i <= INVALID; i++) {
+    servos[i] = new (storage[i]) VarSpeedServo(engine);
+    attached[i] = false;
+  }
+
+  while (script.size) {
+    uint8_t op = script.u8();
+    uint8_t i = script.u8() % servoCount;
+    Script arguments = script;
+    call(op, i, script);
+    check();
+    if (i != INVALID && servoCall(op)) {
+      call(op, INVALID, arguments);
+      check();
+    }
+  }
+
+  // two refresh frames of every channel (PPM takes two edges per channel)
+  engine.stopAll();
+  for (uint8_t edges = 0; edges < 4 * (MAX_SERVOS + 1); edges++)
+    edge();
+  for (uint8_t i = 0; i < MAX_SERVOS; i++) {
+    if (attached[i] && servos[i]->isMoving())
+      fail("still moving after stopAll()", i, servos[i]->readMicroseconds());
+  }
+  return 0;
+}
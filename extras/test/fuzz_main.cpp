@@ -0,0 +1,51 @@
+/*
+  fuzz_main.cpp - Runs a libFuzzer target without libFuzzer.
+
+  With file arguments each file is run as one input, to replay crashes. Without, the given
+  number of pseudo random inputs (default 20000) is run from a fixed seed, so every run of
+  run.sh tests the same inputs.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint32_t state = 2463534242u;
+
+static uint32_t next()
+{
+  state ^= state << 13;         // xorshift32
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+int main(int argc, char **argv)
+{
+  static uint8_t input[4096];
+  if (argc > 1 && argv[1][0] != '-') {
+    for (int arg = 1; arg < argc; arg++) {
+      FILE *file = fopen(argv[arg], "rb");
+      if (file == NULL) {
+        perror(argv[arg]);
+        return 1;
+      }
+      size_t size = fread(input, 1, sizeof(input), file);
+      fclose(file);
+      LLVMFuzzerTestOneInput(input, size);
+    }
+    return 0;
+  }
+
+  long runs = argc > 1 ? atol(argv[1] + 1) : 20000;
+  for (long run = 0; run < runs; run++) {
+    size_t size = next() % sizeof(input);
+    for (size_t i = 0; i < size; i++)
+      input[i] = next();
+    LLVMFuzzerTestOneInput(input, size);
+  }
+  printf("fuzz_api: %ld inputs\n", runs);
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+  harness.h - The engine, checks and frame runner the host tests share.
+
+  Define TEST as the name of the test before including it, every failure is printed as
+  "<TEST>: <message><context>" up to the first ten, and counted in failures. A test may describe
+  the case it runs in context, it is printed after each message.
+
+  frame() runs one refresh frame of timer 0, calling handleInterrupt() at each compare match of a
+  counter that jumps to it, and returns the pulse sent on pin 9 in ticks. receive() sets the input
+  channels from an iBUS packet, after beginSerialInput(SERIAL_IBUS).
+*/
+
+#ifndef harness_h
+#define harness_h
+
+#include <Arduino.h>
+#include <VarSpeedServo.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+static ServoController engine;
+static volatile uint16_t count;
+static volatile uint16_t compare;
+static int failures;
+static char context[100];
+
+// counts a failure and prints it, unless ten were printed before
+static inline void fail(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static inline void fail(const char *format, ...)
+{
+  if (failures++ >= 10)
+    return;
+  va_list args;
+  va_start(args, format);
+  printf("%s: ", TEST);
+  vprintf(format, args);
+  printf("%s\n", context);
+  va_end(args);
+}
+
+static inline void expect(const char *what, long value, long expected)
+{
+  if (value != expected)
+    fail("%s is %ld, expected %ld", what, value, expected);
+}
+
+static inline void expectBetween(const char *what, long value, long low, long high)
+{
+  if (value < low || value > high)
+    fail("%s is %ld, expected %ld to %ld", what, value, low, high);
+}
+
+// the pulse in ticks of a servo written us, less the trim for the interrupt overhead
+static inline long usToPulse(int us)
+{
+  return (long)(us - 2) * clockCyclesPerMicrosecond() / 8;
+}
+
+// one refresh frame of timer 0 of the engine, the pulse of pin 9 in ticks or 0 if it sent none
+static inline long frame(ServoController &engine, volatile uint16_t &count, volatile uint16_t &compare)
+{
+  uint8_t servos = engine.count() < SERVOS_PER_TIMER ? engine.count() : SERVOS_PER_TIMER;
+  long pulse = 0;
+  for (uint8_t edges = 0; edges <= servos; edges++) {   // a pulse edge for each servo and the end of the frame
+    count = compare;
+    engine.handleInterrupt((timer16_Sequence_t)0, &count, &compare);
+    if (hostPortB & digitalPinToBitMask(9))
+      pulse = (uint16_t)(compare - count);
+  }
+  return pulse;
+}
+
+static inline long frame()
+{
+  return frame(engine, count, compare);
+}
+
+// passes an iBUS packet to serialInput(), setting input channels 0 to 13 to the pulse widths in uS
+static inline void receive(const unsigned int values[14])
+{
+  uint8_t packet[32] = {0x20, 0x40};
+  for (uint8_t channel = 0; channel < 14; channel++) {
+    packet[2 + 2 * channel] = values[channel] & 0xFF;
+    packet[3 + 2 * channel] = values[channel] >> 8;
+  }
+  unsigned int sum = 0xFFFF;
+  for (uint8_t i = 0; i < 30; i++)
+    sum -= packet[i];
+  packet[30] = sum & 0xFF;
+  packet[31] = sum >> 8;
+  for (uint8_t i = 0; i < 32; i++)
+    VarSpeedServo::serialInput(packet[i]);
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  Arduino.cpp - The registers, pins and clock of the host mock.
+*/
+
+#include <Arduino.h>
+
+#define HOST_DEFINE8(name)  volatile uint8_t host##name;
+#define HOST_DEFINE16(name) volatile uint16_t host##name;
+HOST_REGISTERS(HOST_DEFINE8, HOST_DEFINE16)
+
+unsigned long hostMicros;
+volatile uint8_t hostPortB;
+volatile uint8_t hostPortD;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  volatile uint8_t *out = portOutputRegister(digitalPinToPort(pin));
+  if (value)
+    *out |= digitalPinToBitMask(pin);
+  else
+    *out &= ~digitalPinToBitMask(pin);
+}
+
+unsigned long micros()
+{
+  return hostMicros;
+}
+
+unsigned long millis()
+{
+  return hostMicros / 1000;
+}
+
+void delay(unsigned long ms)
+{
+  hostMicros += ms * 1000;
+}
@@ -0,0 +1,50 @@
+/*
+  Arduino.h - Just enough of the Arduino core to compile VarSpeedServo on the host.
+
+  Pins are written to two fake ports, time is hostMicros, which only tests advance
+  (delay() advances it too). Interrupts are never enabled, cli() and sei() do nothing.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <avr/interrupt.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) { return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin; }
+#define _BV(bit) (1 << (bit))
+
+static const uint8_t A0 = 14;
+#define NUM_DIGITAL_PINS 20           // an Uno
+#define NOT_A_PIN 0
+
+extern unsigned long hostMicros;      // the time returned by micros()
+extern volatile uint8_t hostPortB;    // pins 8 and up
+extern volatile uint8_t hostPortD;    // pins 0 to 7
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+
+inline uint8_t digitalPinToPort(uint8_t pin) { return pin >= NUM_DIGITAL_PINS ? NOT_A_PIN : pin < 8 ? 4 : 2; }
+inline uint8_t digitalPinToBitMask(uint8_t pin) { return 1 << (pin & 7); }
+inline volatile uint8_t *portOutputRegister(uint8_t port) { return port == 2 ? &hostPortB : &hostPortD; }
+
+#endif
@@ -0,0 +1,15 @@
+/*
+  avr/interrupt.h - Interrupt handlers become plain functions the tests call.
+*/
+
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define cli() do {} while (0)
+#define sei() do {} while (0)
+#define SIGNAL(vector) extern "C" void vector(void); void vector(void)
+#define ISR(vector, ...) extern "C" void vector(void); void vector(void)
+
+#endif
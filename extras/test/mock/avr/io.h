@@ -0,0 +1,81 @@
+/*
+  avr/io.h - The registers of an ATmega328P that VarSpeedServo uses, as plain variables.
+
+  Every register is a macro naming a variable, so the #if defined(REGISTER) checks of the
+  library see the same chip as on an Uno. Bit numbers are those of the datasheet.
+*/
+
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+#include <stdint.h>
+
+#define HOST_REGISTER8(name)  extern volatile uint8_t host##name;
+#define HOST_REGISTER16(name) extern volatile uint16_t host##name;
+#define HOST_REGISTERS(R8, R16) \
+  R8(SREG) \
+  R8(TCCR1A) R8(TCCR1B) R16(TCNT1) R16(OCR1A) R16(ICR1) R8(TIFR1) R8(TIMSK1) \
+  R8(TCCR2A) R8(TCCR2B) R8(TCNT2) R8(OCR2A) R8(TIFR2) R8(TIMSK2) \
+  R8(ADMUX) R8(ADCSRA) R8(ADCSRB) R16(ADC) \
+  R8(UCSR0A) R8(UCSR0B) R8(UCSR0C) R8(UDR0) R16(UBRR0)
+HOST_REGISTERS(HOST_REGISTER8, HOST_REGISTER16)
+
+#define SREG    hostSREG
+#define TCCR1A  hostTCCR1A
+#define TCCR1B  hostTCCR1B
+#define TCNT1   hostTCNT1
+#define OCR1A   hostOCR1A
+#define ICR1    hostICR1
+#define TIFR1   hostTIFR1
+#define TIMSK1  hostTIMSK1
+#define TCCR2A  hostTCCR2A
+#define TCCR2B  hostTCCR2B
+#define TCNT2   hostTCNT2
+#define OCR2A   hostOCR2A
+#define TIFR2   hostTIFR2
+#define TIMSK2  hostTIMSK2
+#define ADMUX   hostADMUX
+#define ADCSRA  hostADCSRA
+#define ADCSRB  hostADCSRB
+#define ADC     hostADC
+#define UCSR0A  hostUCSR0A
+#define UCSR0B  hostUCSR0B
+#define UCSR0C  hostUCSR0C
+#define UDR0    hostUDR0
+#define UBRR0   hostUBRR0
+
+#define CS11    1       // TCCR1B
+#define ICES1   6
+#define ICNC1   7
+#define OCF1A   1       // TIFR1
+#define ICF1    5
+#define OCIE1A  1       // TIMSK1
+#define ICIE1   5
+#define CS20    0       // TCCR2B
+#define CS21    1
+#define TOV2    0       // TIFR2
+#define OCF2A   1
+#define TOIE2   0       // TIMSK2
+#define OCIE2A  1
+#define ADPS0   0       // ADCSRA
+#define ADPS1   1
+#define ADPS2   2
+#define ADIE    3
+#define ADIF    4
+#define ADSC    6
+#define ADEN    7
+#define REFS0   6       // ADMUX
+#define U2X0    1       // UCSR0A
+#define UPE0    2
+#define DOR0    3
+#define FE0     4
+#define RXEN0   4       // UCSR0B
+#define RXCIE0  7
+#define UCSZ00  1       // UCSR0C
+#define UCSZ01  2
+#define USBS0   3
+#define UPM01   5
+
+#define USART_RX_vect USART_RX_vect
+
+#endif
@@ -0,0 +1,93 @@
+#!/bin/sh
+# Builds the library against the host mock in mock/ and runs every test, with the address and
+# undefined behavior sanitizers. Needs a C++11 compiler, set CXX to use another than g++.
+#
+#   extras/test/run.sh            run test_*.cpp and 20000 fuzz_api inputs
+#   extras/test/run.sh -N         run test_*.cpp and N fuzz_api inputs
+#   extras/test/run.sh crash-...  replay files through fuzz_api
+#
+# With avr-gcc, avr-size, simavr and the Arduino AVR core it also builds examples/Benchmark for an
+# ATmega328P, prints its flash and RAM use and runs it under simavr. Set ARDUINO_AVR to the core,
+# the directory holding cores/ and variants/, if it isn't installed in ~/.arduino15.
+
+set -e
+cd "$(dirname "$0")"
+CXX=${CXX:-g++}
+BUILD=${BUILD:-/tmp/varspeedservo-test}
+FLAGS="-std=gnu++11 -g -O1 -Wall -Wno-unused-parameter -fno-sanitize-recover=all -fsanitize=address,undefined -Imock -I../.."
+# the options commented out in VarSpeedServo.h that only cost RAM, the tests are built with them
+OPTIONS="-DVARSPEEDSERVO_CURVES -DVARSPEEDSERVO_FILTERS -DVARSPEEDSERVO_MIX"
+
+mkdir -p "$BUILD"
+build() {
+  name=$1
+  shift
+  $CXX $FLAGS $OPTIONS -o "$BUILD/$name" "$@" mock/Arduino.cpp ../../VarSpeedServo.cpp
+}
+
+build fuzz_api fuzz_api.cpp fuzz_main.cpp
+if [ $# -gt 0 ] && [ "${1#-}" = "$1" ]; then
+  "$BUILD/fuzz_api" "$@"
+  exit
+fi
+
+for test in test_*.cpp; do
+  [ -e "$test" ] || continue
+  name=${test%.cpp}
+  build "$name" "$test"
+  "$BUILD/$name"
+done
+# service() derives its ticks from micros(), check clocks that aren't multiples of 8 MHz
+for cpu in 12000000 20000000; do
+  build test_service_$cpu -DF_CPU=${cpu}UL test_service.cpp
+  "$BUILD/test_service_$cpu"
+done
+build test_timing_timer2 -DVARSPEEDSERVO_TIMER2 test_timing.cpp
+"$BUILD/test_timing_timer2"
+build test_follow_analog -DVARSPEEDSERVO_ANALOG_INPUT test_follow.cpp
+"$BUILD/test_follow_analog"
+# long is 32 bits as on AVR with -m32, so overflows of the unsigned long math show up
+if echo 'int main() { return 0; }' | $CXX $FLAGS -m32 -x c++ -o "$BUILD/m32" - 2>/dev/null; then
+  build test_acceleration_m32 -m32 test_acceleration.cpp
+  "$BUILD/test_acceleration_m32"
+else
+  echo "test_acceleration: skipped the build with a 32 bit long, $CXX can't build with -m32"
+fi
+# and without them, as the library is shipped: angles map linearly and read() must still invert them
+OPTIONS=
+build test_curve_plain test_curve.cpp
+"$BUILD/test_curve_plain"
+build fuzz_api_plain fuzz_api.cpp fuzz_main.cpp
+# the Benchmark sketch on the AVR itself: text, data and bss from avr-size and what it prints at
+# 16 MHz, the sketch idles once it printed everything so simavr is stopped after a minute
+benchmark() {
+  core=$ARDUINO_AVR/cores/arduino
+  out=$BUILD/benchmark
+  AVRFLAGS="-mmcu=atmega328p -DF_CPU=16000000UL -DARDUINO=10819 -DARDUINO_AVR_UNO -DARDUINO_ARCH_AVR -Os -ffunction-sections -fdata-sections -I$core -I$ARDUINO_AVR/variants/standard -I../.."
+  CXXFLAGS="-std=gnu++11 -fno-exceptions -fno-threadsafe-statics"
+  mkdir -p "$out"
+  objects=
+  for source in "$core"/*.c "$core"/*.cpp "$core"/*.S ../../VarSpeedServo.cpp; do
+    [ -e "$source" ] || continue
+    object=$out/$(basename "$source").o
+    case $source in
+      *.c) avr-gcc $AVRFLAGS -std=gnu11 -c -o "$object" "$source" ;;
+      *.S) avr-gcc $AVRFLAGS -x assembler-with-cpp -c -o "$object" "$source" ;;
+      *) avr-g++ $AVRFLAGS $CXXFLAGS -c -o "$object" "$source" ;;
+    esac
+    objects="$objects $object"
+  done
+  avr-g++ $AVRFLAGS $CXXFLAGS -x c++ -include Arduino.h -c -o "$out/Benchmark.o" ../../examples/Benchmark/Benchmark.ino
+  avr-gcc -mmcu=atmega328p -Os -Wl,--gc-sections -o "$out/Benchmark.elf" "$out/Benchmark.o" $objects -lm
+  avr-size "$out/Benchmark.elf"
+  timeout 60 simavr -m atmega328p -f 16000000 "$out/Benchmark.elf" || [ $? -eq 124 ]
+}
+ARDUINO_AVR=${ARDUINO_AVR:-$(ls -d "$HOME"/.arduino15/packages/arduino/hardware/avr/* 2>/dev/null | tail -n 1)}
+if command -v avr-gcc >/dev/null && command -v avr-size >/dev/null && command -v simavr >/dev/null &&
+   command -v timeout >/dev/null && [ -e "$ARDUINO_AVR/cores/arduino/Arduino.h" ]; then
+  benchmark
+else
+  echo "Benchmark: skipped, needs avr-gcc, avr-size, simavr, timeout and the Arduino AVR core in ARDUINO_AVR"
+fi
+"$BUILD/fuzz_api" "$@"
+"$BUILD/fuzz_api_plain" "$@"
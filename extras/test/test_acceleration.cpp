@@ -0,0 +1,150 @@
+/*
+  test_acceleration.cpp - Every acceleration must convert without overflow, and ramps must stay
+  inside the limits when retargeted.
+
+  Each input of setAccelerationMicroseconds() from 0 to 65535 runs a full move at the fastest
+  rate. While it has room to brake, the move must speed up by the acceleration the input converts
+  to, checked against the pulse of every frame, and it must then land on the target. Streams of
+  targets at random speeds are written during accelerating moves: no frame may leave the limits,
+  a target the servo can stop on must not be passed, and the last one must be reached. run.sh
+  builds this test again with a 32 bit long, as on AVR, where the compiler can.
+*/
+
+#define TEST "test_acceleration"
+#include "harness.h"
+
+#define LOW_LIMIT 1000
+#define HIGH_LIMIT 2000
+#define FASTEST 0x7FFF                // velocity is kept in an int
+
+static unsigned long retargets;
+
+// the change of the step per frame, in 1/256 ticks, for the acceleration in uS per second squared
+static long acceleration(unsigned int rate)
+{
+  unsigned long long step = (unsigned long long)rate * clockCyclesPerMicrosecond() / 8 * (256ULL * REFRESH_INTERVAL / 1000) / 1000;
+  long accel = step * REFRESH_INTERVAL / 1000000;
+  return accel == 0 && rate != 0 ? 1 : accel;
+}
+
+static unsigned long brakingDistance(long velocity, long accel)
+{
+  return (unsigned long long)velocity * (velocity + accel) / (2 * accel);
+}
+
+// moves across the whole range with the acceleration set to rate, which must convert to accel
+static void accelerate(VarSpeedServo &servo, unsigned int rate, long accel)
+{
+  snprintf(context, sizeof(context), ", at %u uS/s^2", rate);
+  servo.writeMicroseconds(LOW_LIMIT);
+  frame();
+  servo.setAccelerationMicroseconds(rate);
+  servo.writeMicrosecondsAtRate(HIGH_LIMIT, 0xFFFF);
+
+  long from = usToPulse(LOW_LIMIT);
+  long to = usToPulse(HIGH_LIMIT);
+  long position = 0;
+  long velocity = 0;
+  unsigned long remaining = (to - from) * 256;
+  long last = from;
+  unsigned long frames = 0;
+  for (;;) {
+    long next = accel == 0 ? 0xFFFF : velocity + accel < FASTEST ? velocity + accel : FASTEST;
+    if ((unsigned long)next >= remaining || (accel && brakingDistance(next, accel) > remaining))
+      break;
+    velocity = next;
+    position += velocity;
+    remaining -= velocity;
+    last = frame();
+    frames++;
+    if (last != from + (position >> 8)) {
+      expect("pulse while speeding up", last, from + (position >> 8));
+      return;
+    }
+  }
+  while (servo.isMoving() && frames < 10000) {
+    long pulse = frame();
+    frames++;
+    if (pulse < last || pulse > to) {
+      expect("pulse between the last one and the target", pulse, to);
+      return;
+    }
+    last = pulse;
+  }
+  expect("pulse at the end of the move", last, to);
+  expect("servo moving at the end of the move", servo.isMoving(), 0);
+}
+
+// a small linear congruential generator, so every run writes the same targets
+static uint32_t seed = 1;
+static unsigned int pick(unsigned int range)
+{
+  seed = seed * 1103515245UL + 12345;
+  return (seed >> 16) % range;
+}
+
+// writes a new target every few frames of an accelerated move and checks every frame
+static void stream(VarSpeedServo &servo, unsigned int rate)
+{
+  snprintf(context, sizeof(context), ", at %u uS/s^2", rate);
+  long accel = acceleration(rate);
+  servo.setAccelerationMicroseconds(rate);
+  long last = frame();
+  long previous = last;
+  int target = LOW_LIMIT;
+  long to = 0;
+  int direction = 0;                  // direction towards a target that must not be passed
+  for (unsigned int frames = 0; frames < 20000; frames++) {
+    if (frames < 400 && pick(8) == 0) {
+      target = LOW_LIMIT - 100 + pick(HIGH_LIMIT - LOW_LIMIT + 201);
+      if (pick(2))
+        servo.write(target, 1 + pick(255));
+      else
+        servo.writeMicrosecondsAtRate(target, 1 + pick(4000));
+      retargets++;
+      // heading towards the target and slow enough to stop on it, judged with the fastest
+      // velocity the last step of the pulse allows
+      to = usToPulse(constrain(target, LOW_LIMIT, HIGH_LIMIT));
+      long moved = last - previous;
+      long velocity = (labs(moved) + 1) * 256;
+      long remaining = labs(to - last) * 256 - 255;
+      direction = 0;
+      if (remaining > 0 && (moved == 0 || (moved > 0) == (to > last)) && brakingDistance(velocity, accel) <= (unsigned long)remaining)
+        direction = to > last ? 1 : -1;
+    }
+    else if (frames >= 400 && !servo.isMoving())
+      break;
+    previous = last;
+    last = frame();
+    if (last < usToPulse(LOW_LIMIT) || last > usToPulse(HIGH_LIMIT))
+      expect("pulse between the limits", last, to);
+    if ((direction > 0 && last > to) || (direction < 0 && last < to)) {
+      expect("pulse not past a target the servo could stop on", last, to);
+      direction = 0;
+    }
+  }
+  expect("pulse at the last target", last, to);
+  expect("servo moving after the last target", servo.isMoving(), 0);
+}
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, LOW_LIMIT, HIGH_LIMIT);
+  frame();
+
+  // values quoted when the conversion overflowed above 20971 uS/s^2
+  expect("acceleration of 21000 uS/s^2", acceleration(21000), 4300);
+  expect("acceleration of 30000 uS/s^2", acceleration(30000), 6144);
+  expect("acceleration of 65535 uS/s^2", acceleration(65535), 13421);
+  for (unsigned long rate = 0; rate <= 0xFFFF; rate++)
+    accelerate(servo, rate, acceleration(rate));
+
+  static const unsigned int rates[] = {100, 1000, 5000, 20000, 30000, 65535};
+  for (uint8_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    for (uint8_t streams = 0; streams < 150; streams++)
+      stream(servo, rates[r]);
+
+  printf("test_acceleration: %lu retargets, %d failures\n", retargets, failures);
+  return failures != 0;
+}
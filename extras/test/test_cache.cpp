@@ -0,0 +1,43 @@
+/*
+  test_cache.cpp - Writing the last value again must be skipped, unless the servo was changed
+  without its object meanwhile, by stopAll() or setTicks().
+*/
+
+#define TEST "test_cache"
+#include "harness.h"
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, 1000, 2000);
+
+  // a filtered servo stopped on its way to the written angle
+  servo.setFilter(FILTER_EMA(3));
+  servo.write(0);
+  frame();
+  engine.stopAll();
+  frame();
+  int stopped = servo.readMicroseconds();
+  expect("filtered servo stopped between its ends", stopped > 1000 && stopped < 2000, 1);
+  for (uint8_t frames = 0; frames < 100; frames++)
+    frame();
+  expect("servo after stopAll()", servo.readMicroseconds(), stopped);
+  servo.write(0);
+  for (uint8_t frames = 0; frames < 100; frames++)
+    frame();
+  expect("servo written the same angle after stopAll()", servo.readMicroseconds(), 1000);
+
+  // a servo set by an interrupt handler
+  servo.setFilter(FILTER_NONE);
+  servo.writeMicroseconds(1200);
+  engine.setTicks(0, 1800 * clockCyclesPerMicrosecond() / 8);
+  servo.writeMicroseconds(1200);
+  expect("servo written the same pulse after setTicks()", servo.readMicroseconds(), 1200);
+  servo.write(90);
+  engine.setTicks(0, 1800 * clockCyclesPerMicrosecond() / 8);
+  servo.write(90);
+  expect("servo written the same angle after setTicks()", servo.readMicroseconds(), 1500);
+
+  printf("test_cache: %d failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,77 @@
+/*
+  test_curve.cpp - read() must invert write(angle) for every shape of the angle curve.
+
+  For every angle the pulse written must read back as the lowest angle sending the same pulse,
+  for every pulse width read() must return the nearest angle, and a sequence must get past
+  positions on a flat part of the curve. run.sh builds this test again without
+  VARSPEEDSERVO_CURVES, where every shape is the linear map.
+*/
+
+#define TEST "test_curve"
+#include "harness.h"
+
+int main()
+{
+  static const int ranges[][2] = {{544, 2400}, {1000, 2000}, {1490, 1510}, {600, 2200}};
+  static const int trims[] = {0, -300, 37, 600};
+  static const int expos[] = {0, 30, 100};
+  long cases = 0;
+
+  for (uint8_t r = 0; r < 4; r++)
+    for (uint8_t t = 0; t < 4; t++)
+      for (uint8_t e = 0; e < 3; e++)
+        for (uint8_t reversed = 0; reversed < 2; reversed++) {
+          const int min = ranges[r][0], max = ranges[r][1], trim = trims[t], expo = expos[e];
+          snprintf(context, sizeof(context), " (range %d-%d, trim %d, expo %d, reversed %d)", min, max, trim, expo, reversed);
+          engine = ServoController();
+          VarSpeedServo servo(engine);
+          servo.attach(9, min, max);
+          servo.setTrim(trim);
+          servo.setExpo(expo);
+          servo.setReverse(reversed);
+
+          int pulse[181];
+          for (int angle = 0; angle <= 180; angle++) {
+            servo.write(angle);
+            pulse[angle] = servo.readMicroseconds();
+          }
+          for (int angle = 0; angle <= 180; angle++) {
+            servo.writeMicroseconds(pulse[angle]);
+            int read = servo.read();
+            if (pulse[read] != pulse[angle] || (read > 0 && pulse[read - 1] == pulse[angle]))
+              fail("angle does not read back, %d gives %d", angle, read);
+            cases++;
+          }
+          for (int us = min - 20; us <= max + 20; us++) {
+            servo.writeMicroseconds(us);
+            int actual = servo.readMicroseconds();
+            int read = servo.read();
+            int nearest = 0;
+            for (int angle = 1; angle <= 180; angle++)
+              if (abs(pulse[angle] - actual) < abs(pulse[nearest] - actual))
+                nearest = angle;
+            if (read != nearest)
+              fail("pulse width does not read as the nearest angle, %d gives %d", us, read);
+            cases++;
+          }
+
+          // both ends of the curve may be flat, a sequence must still go round
+          servoSequencePoint sequence[] = {{0, 0}, {180, 0}, {90, 0}};
+          uint8_t position = servo.sequencePlay(sequence, 3, true, 0);
+          uint8_t steps = 0;
+          while (steps < 6) {
+            uint8_t next = servo.sequencePlay(sequence, 3, true, 0);
+            if (next == position)
+              break;
+            position = next;
+            steps++;
+          }
+          if (steps < 6)
+            fail("sequence stalled, %d gives %d", sequence[position].position, servo.read());
+          cases++;
+          servo.detach();
+        }
+
+  printf("test_curve: %ld cases, %d failures\n", cases, failures);
+  return failures != 0;
+}
@@ -0,0 +1,55 @@
+/*
+  test_dither.cpp - Dithered pulses must deliver the fraction written, spread over the frames.
+
+  Every fraction of writeMicroseconds() is sent for 256 frames with setDither(true): each pulse
+  must be the whole tick or one more, the pulses must add up to the exact fractional width, and
+  after any number of frames they must be within a tick of it. Without dithering the pulse must
+  stay on the whole tick.
+*/
+
+#define TEST "test_dither"
+#include "harness.h"
+
+// sends value uS and fraction/256 uS for 256 frames
+static void testFraction(VarSpeedServo &servo, int value, uint8_t fraction, bool dither)
+{
+  snprintf(context, sizeof(context), ", %d uS and %d/256%s", value, fraction, dither ? "" : " undithered");
+  servo.setDither(dither);
+  servo.writeMicrosecondsFine(value, fraction);
+
+  // the width in 1/256 ticks, as writeMicrosecondsFine() converts it
+  long width = (((long)(value - 2) << 8) + fraction) * clockCyclesPerMicrosecond() / 8;
+  long ticks = width >> 8;
+  long sum = 0;
+  for (unsigned int n = 1; n <= 256; n++) {
+    long pulse = frame();
+    if (pulse != ticks && !(dither && pulse == ticks + 1)) {
+      expect("dithered pulse", pulse, ticks);
+      return;
+    }
+    sum += pulse;
+    long error = sum * 256 - n * width;
+    if (dither && (error <= -256 || error >= 256)) {
+      expectBetween("error in 1/256 ticks after a number of frames", error, -255, 255);
+      return;
+    }
+  }
+  expect("sum of 256 pulses in ticks", sum, dither ? width : ticks * 256);
+}
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, 1000, 2000);
+  frame();
+
+  for (unsigned int fraction = 0; fraction < 256; fraction++) {
+    testFraction(servo, 1500, fraction, true);
+    testFraction(servo, 1000, fraction, true);
+  }
+  testFraction(servo, 1500, 77, false);
+  testFraction(servo, 1999, 200, true);
+
+  printf("test_dither: %d failures\n", failures);
+  return failures != 0;
+}
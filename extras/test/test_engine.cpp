@@ -0,0 +1,76 @@
+/*
+  test_engine.cpp - Engines must start from a clean state wherever they live, and must not share it.
+
+  The constructor is constexpr so ServoEngine is set up before any constructor runs; an engine
+  built over dirty memory must be as empty as a global one, and servos of separate engines must
+  not see each other.
+*/
+
+#define TEST "test_engine"
+#include "harness.h"
+#include <new>
+#include <string.h>
+
+static constexpr ServoController constant;         // fails to compile if the constructor isn't constant
+static ServoController global;                      // zeroed like ServoEngine
+
+static void testDirtyMemory()
+{
+  static unsigned char memory[sizeof(ServoController)] __attribute__((aligned(8)));
+  memset(memory, 0xA5, sizeof(memory));
+  ServoController *engine = new (memory) ServoController();
+  servoSnapshot states[MAX_SERVOS];
+
+  expect("servos of an engine over dirty memory", engine->count(), 0);
+  expect("edge delay of an engine over dirty memory", engine->edgeDelay(), 0);
+  expect("snapshot of an engine over dirty memory", engine->snapshot(states, MAX_SERVOS), 0);
+
+  VarSpeedServo reference(global);
+  reference.attach(9);
+  VarSpeedServo servo(*engine);
+  expect("servo attached to an engine over dirty memory", servo.attach(9) != INVALID_SERVO, 1);
+  expect("pulse of its servo", servo.readMicroseconds(), reference.readMicroseconds());
+  volatile uint16_t count = 0, compare = 0;
+  frame(*engine, count, compare);
+  expect("pulse of its servo after a frame", servo.readMicroseconds(), reference.readMicroseconds());
+  expect("servo moving after a frame", servo.isMoving(), 0);
+  engine->~ServoController();
+}
+
+static void testSeparateEngines()
+{
+  ServoController *first = new ServoController();
+  ServoController second;
+  volatile uint16_t firstCount = 0, firstCompare = 0, secondCount = 0, secondCompare = 0;
+
+  VarSpeedServo a(*first), b(second);
+  expect("servos of the first engine", first->count(), 1);
+  expect("servos of the second engine", second.count(), 1);
+  a.attach(9);
+  b.attach(10);
+  a.write(0, 20);
+  b.write(180);
+  second.stopAll();
+  for (uint8_t frames = 0; frames < 100; frames++) {
+    frame(*first, firstCount, firstCompare);
+    frame(second, secondCount, secondCompare);
+  }
+  expect("servo of the first engine after stopAll() of the second", a.readMicroseconds(), MIN_PULSE_WIDTH);
+  expect("servo of the second engine", b.readMicroseconds(), MAX_PULSE_WIDTH);
+
+  // a new engine in the place of the first starts over
+  a.detach();
+  first->~ServoController();
+  new (first) ServoController();
+  expect("servos of an engine built again", first->count(), 0);
+  delete first;
+}
+
+int main()
+{
+  expect("servos of a constant engine", const_cast<ServoController &>(constant).count(), 0);
+  testDirtyMemory();
+  testSeparateEngines();
+  printf("test_engine: %d failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,101 @@
+/*
+  test_estimate.cpp - estimateMoveTime() and moveTimeRemaining() must give the frames a move takes.
+
+  Servos at rest and in the middle of moves, with and without acceleration, are estimated and then
+  run frame by frame until they stop. Half of the moves in progress are retargeted, at another
+  speed, towards or away from the way they are heading, or close enough that they overshoot; the
+  estimate before the write and the remaining time after it must both match. Some targets are at
+  the limits, where an overshoot stops.
+*/
+
+#define TEST "test_estimate"
+#include "harness.h"
+
+#define LOW_LIMIT 1000
+#define HIGH_LIMIT 2000
+#define FRAME_MS (REFRESH_INTERVAL / 1000)
+
+static unsigned long moves;
+
+// a small linear congruential generator, so every run writes the same targets
+static uint32_t seed = 1;
+static unsigned int pick(unsigned int range)
+{
+  seed = seed * 1103515245UL + 12345;
+  return (seed >> 16) % range;
+}
+
+static int pickTarget()
+{
+  unsigned int choice = pick(10);
+  return choice == 0 ? LOW_LIMIT : choice == 1 ? HIGH_LIMIT : LOW_LIMIT + pick(HIGH_LIMIT - LOW_LIMIT + 1);
+}
+
+// runs the servo until it stops, in milliseconds
+static unsigned long run(VarSpeedServo &servo)
+{
+  unsigned long frames = 0;
+  while (servo.isMoving() && frames < 100000) {
+    frame();
+    frames++;
+  }
+  return frames * FRAME_MS;
+}
+
+static void move(VarSpeedServo &servo, unsigned int rate)
+{
+  servo.setAccelerationMicroseconds(0);
+  int start = LOW_LIMIT + pick(HIGH_LIMIT - LOW_LIMIT + 1);
+  servo.writeMicroseconds(start);
+  frame();
+  servo.setAccelerationMicroseconds(rate);
+
+  int target = pickTarget();
+  uint8_t speed = 1 + pick(255);
+  snprintf(context, sizeof(context), ", from %d to %d uS at speed %d, %u uS/s^2", start, target, speed, rate);
+  unsigned long estimate = servo.estimateMoveTime(target, speed);
+  servo.write(target, speed);
+  unsigned long remaining = servo.moveTimeRemaining();
+  unsigned int frames = pick(40);
+  if (frames == 0) {
+    expect("estimated ms", estimate, run(servo));
+    expect("remaining ms", remaining, estimate);
+    moves++;
+    return;
+  }
+  for (unsigned int i = 0; i < frames && servo.isMoving(); i++)
+    frame();
+
+  if (pick(2)) {
+    remaining = servo.moveTimeRemaining();
+    expect("remaining ms during the move", remaining, run(servo));
+  }
+  else {
+    int retarget = pickTarget();
+    speed = 1 + pick(255);
+    snprintf(context, sizeof(context), ", from %d to %d uS, after %u frames to %d uS at speed %d, %u uS/s^2",
+             start, target, frames, retarget, speed, rate);
+    estimate = servo.estimateMoveTime(retarget, speed);
+    servo.write(retarget, speed);
+    remaining = servo.moveTimeRemaining();
+    unsigned long actual = run(servo);
+    expect("estimated ms of a retarget", estimate, actual);
+    expect("remaining ms after a retarget", remaining, actual);
+  }
+  moves++;
+}
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, LOW_LIMIT, HIGH_LIMIT);
+  frame();
+
+  static const unsigned int rates[] = {0, 1, 100, 1000, 5000, 20000, 65535};
+  for (uint8_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    for (unsigned int i = 0; i < 3000; i++)
+      move(servo, rates[r]);
+
+  printf("test_estimate: %lu moves, %d failures\n", moves, failures);
+  return failures != 0;
+}
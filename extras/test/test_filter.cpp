@@ -0,0 +1,123 @@
+/*
+  test_filter.cpp - Filtered writes must reach what was written, the way setFilter() describes.
+
+  FILTER_EMA(shift) must move 1/2^shift of the remaining distance each frame, in 1/256 ticks, and
+  land on the target; FILTER_MEDIAN must drop a value written for a single frame and follow one
+  written for two. Slow moves must run as they do unfiltered, and FILTER_NONE must send writes at
+  once again.
+*/
+
+#define TEST "test_filter"
+#include "harness.h"
+
+#define LOW_LIMIT 1000
+#define HIGH_LIMIT 2000
+
+static void frames(uint8_t n)
+{
+  while (n--)
+    frame();
+}
+
+// a move from one end to the other, checked against the pulse the average gives every frame
+static void testEma(VarSpeedServo &servo, uint8_t shift, int from, int to)
+{
+  snprintf(context, sizeof(context), ", FILTER_EMA(%d) from %d to %d uS", shift, from, to);
+  servo.setFilter(FILTER_NONE);
+  servo.writeMicroseconds(from);
+  frame();
+  servo.setFilter(FILTER_EMA(shift));
+  servo.writeMicroseconds(to);
+
+  long position = usToPulse(from) << 8;
+  long target = usToPulse(to) << 8;
+  unsigned int n;
+  for (n = 0; n < 2000 && position != target; n++) {
+    position += (target - position) >> shift;
+    if (labs(target - position) < 256)
+      position = target;
+    long pulse = frame();
+    if (pulse != position >> 8) {
+      expect("filtered pulse", pulse, position >> 8);
+      return;
+    }
+  }
+  expect("filtered pulse at the end", frame(), usToPulse(to));
+  expect("servo moving after the filter settled", servo.isMoving(), 0);
+}
+
+static void testMedian(VarSpeedServo &servo)
+{
+  snprintf(context, sizeof(context), ", FILTER_MEDIAN");
+  servo.setFilter(FILTER_NONE);
+  servo.writeMicroseconds(1500);
+  frame();
+  servo.setFilter(FILTER_MEDIAN);
+  frames(3);
+
+  servo.writeMicroseconds(1900);                          // a glitch of one frame
+  expect("pulse during a glitch", frame(), usToPulse(1500));
+  servo.writeMicroseconds(1500);
+  expect("pulse after a glitch", frame(), usToPulse(1500));
+  expect("pulse after a glitch", frame(), usToPulse(1500));
+
+  servo.writeMicroseconds(1200);                          // a step, held
+  expect("pulse in the first frame of a step", frame(), usToPulse(1500));
+  expect("pulse in the second frame of a step", frame(), usToPulse(1200));
+  expect("pulse in the third frame of a step", frame(), usToPulse(1200));
+}
+
+// the pulses of a slow move, with the filter set to filter
+static unsigned int slowMove(VarSpeedServo &servo, uint8_t filter, long *pulses)
+{
+  servo.setFilter(FILTER_NONE);
+  servo.writeMicroseconds(LOW_LIMIT);
+  frame();
+  servo.setFilter(filter);
+  servo.write(180, 20);
+  unsigned int n = 0;
+  while (servo.isMoving() && n < 1000)
+    pulses[n++] = frame();
+  return n;
+}
+
+static void testSlowMove(VarSpeedServo &servo)
+{
+  static long plain[1000], filtered[1000];
+  unsigned int n = slowMove(servo, FILTER_NONE, plain);
+  for (uint8_t filter = FILTER_EMA(1); filter <= FILTER_MEDIAN; filter++) {
+    snprintf(context, sizeof(context), ", slow move with filter %d", filter);
+    expect("frames of a slow move", slowMove(servo, filter, filtered), n);
+    for (unsigned int i = 0; i < n; i++)
+      if (filtered[i] != plain[i]) {
+        expect("pulse of a slow move", filtered[i], plain[i]);
+        break;
+      }
+  }
+}
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, LOW_LIMIT, HIGH_LIMIT);
+  frame();
+
+  for (uint8_t shift = 1; shift <= 7; shift++) {
+    testEma(servo, shift, LOW_LIMIT, HIGH_LIMIT);
+    testEma(servo, shift, HIGH_LIMIT, LOW_LIMIT);
+    testEma(servo, shift, 1500, 1501);
+  }
+  testMedian(servo);
+  testSlowMove(servo);
+
+  snprintf(context, sizeof(context), ", FILTER_NONE");
+  servo.setFilter(FILTER_EMA(4));
+  servo.writeMicroseconds(1300);
+  frames(2);
+  servo.setFilter(FILTER_NONE);
+  servo.writeMicroseconds(1700);
+  expect("unfiltered pulse", frame(), usToPulse(1700));
+
+  printf("test_filter: %d failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,96 @@
+/*
+  test_follow.cpp - stop() and stopAll() must end following an input channel, a mix or an analog pin.
+
+  The input channels are set from iBUS packets passed to serialInput(). After a stop the inputs
+  change and the servos must keep the pulse they were stopped at, until they are set to follow
+  again. run.sh builds this test again with -DVARSPEEDSERVO_ANALOG_INPUT, where the ADC interrupt
+  is called with new samples as well.
+*/
+
+#define TEST "test_follow"
+#include "harness.h"
+
+#if defined(VARSPEEDSERVO_ANALOG_INPUT)
+extern "C" void ADC_vect(void);
+#endif
+
+// the input channels 0 to 2 set to the pulse widths in uS
+static void receive(unsigned int a, unsigned int b, unsigned int c)
+{
+  const unsigned int values[14] = {a, b, c, 1500, 1500, 1500, 1500, 1500, 1500, 1500, 1500, 1500, 1500, 1500};
+  receive(values);
+}
+
+static void frames(uint8_t n)
+{
+  while (n--)
+    frame();
+}
+
+int main()
+{
+  VarSpeedServo follower(engine), mixer(engine);
+  follower.attach(9);
+  mixer.attach(10);
+  VarSpeedServo::beginSerialInput(SERIAL_IBUS);
+
+  follower.follow(0);
+  mixer.mix(1, MIX_UNITY / 2, 2, MIX_UNITY / 2);
+  receive(1200, 1000, 2000);
+  frames(2);
+  expect("servo following channel 0", follower.readMicroseconds(), 1200);
+  int mixed = mixer.readMicroseconds();
+  expect("servo mixing channels 1 and 2", mixed, 1500);
+
+  // the repro of the report, stopAll() took the next input again; a stop takes effect at the
+  // start of a frame, so the inputs change one frame later
+  engine.stopAll();
+  frame();
+  receive(1900, 2000, 2000);
+  frames(10);
+  expect("servo following after stopAll()", follower.readMicroseconds(), 1200);
+  expect("servo mixing after stopAll()", mixer.readMicroseconds(), mixed);
+  expect("servo moving after stopAll()", follower.isMoving(), 0);
+
+  follower.follow(0);
+  mixer.mix(1, MIX_UNITY / 2, 2, MIX_UNITY / 2);
+  frames(2);
+  expect("servo following again", follower.readMicroseconds(), 1900);
+  expect("servo mixing again", mixer.readMicroseconds(), 2000);
+  follower.stop();
+  mixer.stop();
+  receive(1100, 1000, 1000);
+  frames(10);
+  expect("servo following after stop()", follower.readMicroseconds(), 1900);
+  expect("servo mixing after stop()", mixer.readMicroseconds(), 2000);
+
+#if defined(VARSPEEDSERVO_ANALOG_INPUT)
+  follower.writeMicroseconds(1500);
+  follower.followAnalog(A0, 0);
+  ADC = 0;
+  frame();
+  ADC_vect();
+  expect("servo following the ADC", follower.readMicroseconds(), MIN_PULSE_WIDTH);
+
+  engine.stopAll();
+  frame();
+  expect("ADC interrupt after stopAll()", (ADCSRA & _BV(ADIE)) != 0, 0);
+  ADC = 1023;
+  ADC_vect();
+  frames(2);
+  expect("servo following the ADC after stopAll()", follower.readMicroseconds(), MIN_PULSE_WIDTH);
+
+  follower.followAnalog(A0, 0);
+  ADC_vect();
+  expect("servo following the ADC again", follower.readMicroseconds(), MAX_PULSE_WIDTH);
+  follower.stop();
+  ADC = 0;
+  ADC_vect();
+  frames(2);
+  expect("servo following the ADC after stop()", follower.readMicroseconds(), MAX_PULSE_WIDTH);
+#endif
+
+  VarSpeedServo::beginSerialInput(0);
+  printf("test_follow: %d failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,90 @@
+/*
+  test_mix.cpp - mix() must send the weighted sum of two input channels, limited to the servo range.
+
+  The elevon and V-tail mixes the README gives are checked with pulse widths worked out by hand,
+  then random inputs and weights from -128 to 127 against the sum of the deviations from center
+  times the weights over MIX_UNITY, in ticks and rounded down as the interrupt does. A second
+  channel that has not received anything must be left out, and NO_INPUT must end the mix.
+*/
+
+#define TEST "test_mix"
+#include "harness.h"
+
+#define LOW_LIMIT 1000
+#define HIGH_LIMIT 2000
+#define UNRECEIVED 15                 // iBUS sets channels 0 to 13
+
+static unsigned int values[14];
+
+// a small linear congruential generator, so every run mixes the same inputs
+static uint32_t seed = 1;
+static unsigned int pick(unsigned int range)
+{
+  seed = seed * 1103515245UL + 12345;
+  return (seed >> 16) % range;
+}
+
+// the pulse of the servo after receiving a and b on channels 0 and 1
+static long mixed(unsigned int a, unsigned int b)
+{
+  values[0] = a;
+  values[1] = b;
+  receive(values);
+  frame();
+  return frame();
+}
+
+// the pulse in ticks for inputs a and b in uS with the weights, less the trim as usToPulse()
+static long expected(unsigned int a, int weightA, unsigned int b, int weightB)
+{
+  const long ticksPerUs = clockCyclesPerMicrosecond() / 8;
+  const long center = DEFAULT_PULSE_WIDTH * ticksPerUs;
+  long sum = ((long)a * ticksPerUs - center) * weightA;
+  if (weightB)
+    sum += ((long)b * ticksPerUs - center) * weightB;
+  long level = (sum >> 6) + center - 2 * ticksPerUs;
+  return constrain(level, usToPulse(LOW_LIMIT), usToPulse(HIGH_LIMIT));
+}
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, LOW_LIMIT, HIGH_LIMIT);
+  VarSpeedServo::beginSerialInput(SERIAL_IBUS);
+  for (uint8_t channel = 0; channel < 14; channel++)
+    values[channel] = 1500;
+
+  servo.mix(0, MIX_UNITY, 1, MIX_UNITY);                  // elevon
+  expect("elevon with pitch up", mixed(1600, 1500), usToPulse(1600));
+  expect("elevon with pitch and roll", mixed(1600, 1600), usToPulse(1700));
+  expect("elevon with pitch and opposite roll", mixed(1600, 1400), usToPulse(1500));
+  expect("elevon past the range", mixed(1900, 1900), usToPulse(HIGH_LIMIT));
+  servo.mix(0, MIX_UNITY, 1, -MIX_UNITY);                 // the other elevon
+  expect("other elevon with pitch and roll", mixed(1600, 1600), usToPulse(1500));
+  expect("other elevon with pitch and opposite roll", mixed(1600, 1400), usToPulse(1700));
+  servo.mix(0, -MIX_UNITY, 1, MIX_UNITY);                 // V-tail
+  expect("V-tail with pitch and yaw", mixed(1400, 1600), usToPulse(1700));
+  expect("V-tail below the range", mixed(1900, 1100), usToPulse(LOW_LIMIT));
+  servo.mix(0, MIX_UNITY / 2, 1, MIX_UNITY / 2);
+  expect("half and half", mixed(1700, 1300), usToPulse(1500));
+  expect("half and half", mixed(1700, 1500), usToPulse(1600));
+
+  for (unsigned int i = 0; i < 20000; i++) {
+    unsigned int a = 900 + pick(1201), b = 900 + pick(1201);
+    int weightA = (int)pick(256) - 128, weightB = (int)pick(256) - 128;
+    snprintf(context, sizeof(context), ", %u uS at %d and %u uS at %d", a, weightA, b, weightB);
+    servo.mix(0, weightA, 1, weightB);
+    expect("mixed pulse", mixed(a, b), expected(a, weightA, b, weightB));
+    servo.mix(0, weightA, UNRECEIVED, weightB);
+    expect("pulse mixed with a channel not received", mixed(a, b), expected(a, weightA, b, 0));
+  }
+  context[0] = 0;
+
+  servo.mix(NO_INPUT, 0);
+  servo.writeMicroseconds(1234);
+  expect("pulse written after NO_INPUT", mixed(1800, 1800), usToPulse(1234));
+
+  VarSpeedServo::beginSerialInput(0);
+  printf("test_mix: %d failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,30 @@
+/*
+  test_pins.cpp - Attaching must fail on pins the board doesn't have.
+
+  The port register of a pin is looked up once by attach() and written by the interrupt, a pin
+  past NUM_DIGITAL_PINS would read it from beyond the port table. The mock is an Uno, pins 0 to
+  19; attach(), attachEsc() and attachPpm() must return INVALID_SERVO for pin 20 and above, and
+  leave the servo detached.
+*/
+
+#define TEST "test_pins"
+#include "harness.h"
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  static const int pins[] = {NUM_DIGITAL_PINS, 63, 64, -1};
+  for (uint8_t i = 0; i < sizeof(pins) / sizeof(pins[0]); i++) {
+    snprintf(context, sizeof(context), ", pin %d", pins[i]);
+    expect("attach()", servo.attach(pins[i]), INVALID_SERVO);
+    expect("attachEsc()", servo.attachEsc(pins[i], ESC_ONESHOT125), INVALID_SERVO);
+    expect("attachPpm()", servo.attachPpm(pins[i]), INVALID_SERVO);
+    expect("servo attached", servo.attached(), 0);
+  }
+  context[0] = 0;
+  expect("attach() on the last pin", servo.attach(NUM_DIGITAL_PINS - 1), 0);
+  servo.detach();
+
+  printf("test_pins: %d failures\n", failures);
+  return failures != 0;
+}
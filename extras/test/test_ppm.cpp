@@ -0,0 +1,93 @@
+/*
+  test_ppm.cpp - A PPM stream must send its markers, channels and sync gap.
+
+  Four servos of an engine run from a virtual counter, one tick at a time, are sent on pin 8. Every
+  marker must last PPM_MARKER_WIDTH, the slots from one rising edge to the next the pulse widths
+  written, and the sync gap must fill the frame to PPM_FRAME_INTERVAL. A servo pin that is high
+  when its timer switches to PPM must be pulled low, the stream never ends its pulse.
+*/
+
+#define TEST "test_ppm"
+#include "harness.h"
+
+static const unsigned long ticksPerUs = clockCyclesPerMicrosecond() / 8;
+
+static void testStream()
+{
+  static const int widths[] = {1000, 1500, 2000, 1234};
+  VarSpeedServo servos[4] = {VarSpeedServo(engine), VarSpeedServo(engine), VarSpeedServo(engine), VarSpeedServo(engine)};
+
+  for (uint8_t i = 0; i < 4; i++) {
+    servos[i].attachPpm(8);
+    servos[i].writeMicroseconds(widths[i]);
+  }
+  // the slots from the rise of each marker to the next, over a few frames
+  unsigned long slots[32];
+  uint8_t slotCount = 0;
+  unsigned long rise = 0;
+  bool high = false;
+  count = compare = 0;
+  for (unsigned long now = 0; slotCount < 32 && now < 10 * PPM_FRAME_INTERVAL * ticksPerUs; now++) {
+    count = now;
+    if (count == compare)
+      engine.handleInterrupt((timer16_Sequence_t)0, &count, &compare);
+    bool pin = hostPortB & digitalPinToBitMask(8);
+    if (pin && !high) {
+      if (rise)
+        slots[slotCount++] = now - rise;
+      rise = now;
+    }
+    else if (!pin && high)
+      expect("PPM marker in ticks", now - rise, PPM_MARKER_WIDTH * ticksPerUs);
+    high = pin;
+  }
+  expect("PPM slots", slotCount, 32);
+
+  // after the first sync gap every frame is the four channels and a sync gap
+  uint8_t i = 0;
+  while (i < slotCount && slots[i] < PPM_MIN_SYNC * ticksPerUs)
+    i++;
+  for (i++; i + 5 <= slotCount; i += 5) {
+    unsigned long frame = 0;
+    for (uint8_t channel = 0; channel < 4; channel++) {
+      long expected = (widths[channel] - 2) * ticksPerUs;
+      expect("PPM channel in ticks", slots[i + channel], expected);
+      frame += slots[i + channel];
+    }
+    expectBetween("PPM sync gap in ticks", slots[i + 4], PPM_MIN_SYNC * ticksPerUs, PPM_FRAME_INTERVAL * ticksPerUs);
+    frame += slots[i + 4];
+    expect("PPM frame in ticks", frame, PPM_FRAME_INTERVAL * ticksPerUs);
+  }
+  for (uint8_t i = 0; i < 4; i++)
+    servos[i].detach();
+}
+
+// a servo pulsing pin 9 when another servo of its timer starts a stream on pin 8
+static void testSwitch()
+{
+  static ServoController engine;
+  volatile uint16_t count = 0, compare = 0;
+  VarSpeedServo servo(engine), stream(engine);
+  servo.attach(9);
+  for (uint8_t edges = 0; edges < 4 && !(hostPortB & digitalPinToBitMask(9)); edges++) {
+    count = compare;
+    engine.handleInterrupt((timer16_Sequence_t)0, &count, &compare);
+  }
+  expect("pin 9 high before the stream", (hostPortB & digitalPinToBitMask(9)) != 0, 1);
+
+  stream.attachPpm(8);
+  expect("pin 9 high after attachPpm()", (hostPortB & digitalPinToBitMask(9)) != 0, 0);
+  for (uint8_t frames = 0; frames < 3; frames++)
+    frame(engine, count, compare);
+  expect("pin 9 high while streaming", (hostPortB & digitalPinToBitMask(9)) != 0, 0);
+  stream.detach();
+  servo.detach();
+}
+
+int main()
+{
+  testStream();
+  testSwitch();
+  printf("test_ppm: %d failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,79 @@
+/*
+  test_ramp.cpp - Slow moves must step towards the target without passing it or the limits, and
+  land on it exactly.
+
+  Every start and target pulse width between limits 100 uS apart, and past them, is moved at every
+  speed of write(value, speed); the steps of the full speed there reach across the whole range in
+  one frame. Slow rates of writeMicrosecondsAtRate(), with steps of a fraction of a tick, move from
+  both limits to every target. The pulse sent in every frame is checked, and the number of frames
+  of each move.
+*/
+
+#define TEST "test_ramp"
+#include "harness.h"
+
+#define LOW_LIMIT 1000
+#define HIGH_LIMIT 1100
+
+static unsigned long moves;
+
+// moves from start to target with write(value, speed), or at the rate in uS per second if speed is
+// 0, and checks every frame
+static void move(VarSpeedServo &servo, int start, int target, uint8_t speed, unsigned int rate)
+{
+  servo.writeMicroseconds(start);
+  frame();
+  unsigned long step;                // 1/256 ticks per frame
+  if (speed) {
+    servo.write(target, speed);
+    step = speed * 256UL;
+  }
+  else {
+    servo.writeMicrosecondsAtRate(target, rate);
+    step = (unsigned long)rate * clockCyclesPerMicrosecond() / 8 * (256UL * REFRESH_INTERVAL / 1000) / 1000;
+  }
+
+  snprintf(context, sizeof(context), ", from %d to %d uS at step %lu", start, target, step);
+  long from = usToPulse(start);
+  long to = usToPulse(constrain(target, LOW_LIMIT, HIGH_LIMIT));
+  long distance = labs(to - from);
+  unsigned long expectedFrames = distance ? (distance * 256 + step - 1) / step : 1;   // a frame ends any move
+  unsigned long frames = 0;
+  long last = from;
+  while (servo.isMoving() && frames <= expectedFrames) {
+    long pulse = frame();
+    frames++;
+    bool passed = to > from ? pulse < last || pulse > to : pulse > last || pulse < to;
+    if (passed || pulse < usToPulse(LOW_LIMIT) || pulse > usToPulse(HIGH_LIMIT)) {
+      expect("pulse between the last one and the target", pulse, to);
+      return;
+    }
+    last = pulse;
+  }
+  expect("frames of the move", frames, expectedFrames);
+  expect("pulse at the end of the move", last, to);
+  expect("pulse after the move", frame(), to);
+  moves++;
+}
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, LOW_LIMIT, HIGH_LIMIT);
+  frame();
+
+  for (int speed = 1; speed <= 255; speed++)
+    for (int start = LOW_LIMIT; start <= HIGH_LIMIT; start++)
+      for (int target = LOW_LIMIT - 10; target <= HIGH_LIMIT + 10; target++)
+        move(servo, start, target, speed, 0);
+
+  static const unsigned int rates[] = {1, 7, 30, 99};
+  for (uint8_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    for (int target = LOW_LIMIT; target <= HIGH_LIMIT; target++) {
+      move(servo, LOW_LIMIT, target, 0, rates[r]);
+      move(servo, HIGH_LIMIT, target, 0, rates[r]);
+    }
+
+  printf("test_ramp: %lu moves, %d failures\n", moves, failures);
+  return failures != 0;
+}
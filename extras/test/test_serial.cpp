@@ -0,0 +1,166 @@
+/*
+  test_serial.cpp - SBUS and iBUS packets must decode to the input channels, bad ones must not.
+
+  The packets are built from the protocol descriptions (SBUS: 25 bytes at 100000 8E2, 16 channels
+  of 11 bits least significant bit first; iBUS: 32 bytes at 115200 8N1, 14 little endian channels
+  and 0xFFFF minus the byte sum), not recorded from a receiver. SBUS packets paused for more than
+  3 mS are dropped.
+*/
+
+#define TEST "test_serial"
+#include "harness.h"
+#include <string.h>
+
+static void feed(const uint8_t *packet, uint8_t size)
+{
+  for (uint8_t i = 0; i < size; i++)
+    VarSpeedServo::serialInput(packet[i]);
+}
+
+static uint8_t sbusPacket(uint8_t *packet, const unsigned int *values, uint8_t flags)
+{
+  memset(packet, 0, 25);
+  packet[0] = 0x0F;
+  for (uint8_t channel = 0; channel < 16; channel++)
+    for (uint8_t bit = 0; bit < 11; bit++)
+      if (values[channel] & (1 << bit)) {
+        unsigned int at = channel * 11 + bit;
+        packet[1 + at / 8] |= 1 << (at % 8);
+      }
+  packet[23] = flags;
+  packet[24] = 0x00;
+  return 25;
+}
+
+static uint8_t ibusPacket(uint8_t *packet, const unsigned int *values)
+{
+  packet[0] = 0x20;
+  packet[1] = 0x40;
+  for (uint8_t channel = 0; channel < 14; channel++) {
+    packet[2 + 2 * channel] = values[channel] & 0xFF;
+    packet[3 + 2 * channel] = values[channel] >> 8;
+  }
+  unsigned int sum = 0xFFFF;
+  for (uint8_t i = 0; i < 30; i++)
+    sum -= packet[i];
+  packet[30] = sum & 0xFF;
+  packet[31] = sum >> 8;
+  return 32;
+}
+
+static void testSbus()
+{
+  uint8_t packet[25];
+  unsigned int values[16];
+  char what[40];
+
+  VarSpeedServo::beginSerialInput(SERIAL_SBUS);
+  for (uint8_t channel = 0; channel < 16; channel++)
+    values[channel] = 172 + channel * 109;                 // 172 to 1807
+  uint8_t size = sbusPacket(packet, values, 0);
+  feed((const uint8_t *)"\x42\x99", 2);                     // line noise before the first header
+  feed(packet, size);
+  for (uint8_t channel = 0; channel < 16; channel++) {
+    sprintf(what, "SBUS channel %d", channel);
+    expect(what, VarSpeedServo::readInput(channel), (values[channel] * 5UL >> 3) + 880);
+  }
+
+  unsigned int last = VarSpeedServo::readInput(0);
+  values[0] = 1811;
+  sbusPacket(packet, values, 0x08);                         // failsafe
+  feed(packet, size);
+  expect("SBUS channel 0 after a failsafe packet", VarSpeedServo::readInput(0), last);
+  sbusPacket(packet, values, 0);
+  packet[24] = 0x55;                                        // bad footer
+  feed(packet, size);
+  expect("SBUS channel 0 after a bad footer", VarSpeedServo::readInput(0), last);
+  packet[24] = 0x14;                                        // SBUS2 footer
+  feed(packet, size);
+  expect("SBUS channel 0 after an SBUS2 packet", VarSpeedServo::readInput(0), 2011);
+
+  // footers sharing the low bits of the SBUS2 ones
+  static const uint8_t footers[] = {0x44, 0x84, 0xC4, 0x08};
+  values[0] = 172;
+  sbusPacket(packet, values, 0);
+  for (uint8_t i = 0; i < sizeof(footers); i++) {
+    packet[24] = footers[i];
+    feed(packet, size);
+    sprintf(what, "SBUS channel 0 after footer 0x%02X", footers[i]);
+    expect(what, VarSpeedServo::readInput(0), 2011);
+  }
+
+  // a packet cut off by a pause, the next one must be decoded from its header on
+  values[0] = 500;
+  sbusPacket(packet, values, 0);
+  feed(packet, 10);
+  hostMicros += 3001;
+  feed(packet, size);
+  expect("SBUS channel 0 after a packet cut off", VarSpeedServo::readInput(0), 1192);
+  values[0] = 1811;
+  sbusPacket(packet, values, 0);
+  feed(packet, 10);
+  hostMicros += 3000;
+  feed(packet + 10, size - 10);
+  expect("SBUS channel 0 after a pause of 3 mS", VarSpeedServo::readInput(0), 2011);
+}
+
+static void testIbus()
+{
+  uint8_t packet[32];
+  unsigned int values[14];
+  char what[40];
+
+  VarSpeedServo::beginSerialInput(SERIAL_IBUS);
+  for (uint8_t channel = 0; channel < 14; channel++)
+    values[channel] = 1000 + channel * 77;
+  uint8_t size = ibusPacket(packet, values);
+  feed((const uint8_t *)"\x20\x41", 2);                     // a packet of another command
+  feed(packet, size);
+  for (uint8_t channel = 0; channel < 14; channel++) {
+    sprintf(what, "iBUS channel %d", channel);
+    expect(what, VarSpeedServo::readInput(channel), values[channel]);
+  }
+
+  values[3] = 1500;
+  ibusPacket(packet, values);
+  packet[31] ^= 1;                                          // bad checksum
+  feed(packet, size);
+  expect("iBUS channel 3 after a bad checksum", VarSpeedServo::readInput(3), 1000 + 3 * 77);
+}
+
+// the latency is timed from micros(), also across its wrap around
+static void testLatency()
+{
+  uint8_t packet[25];
+  unsigned int values[16];
+  static const unsigned long starts[] = {1000, 0xFFFFFE00UL};
+
+  for (uint8_t i = 0; i < 2; i++) {
+    engine = ServoController();
+    count = compare = 0;
+    VarSpeedServo servo(engine);
+    servo.attach(9);
+    servo.follow(15);                                       // the highest channel of a packet
+    VarSpeedServo::beginSerialInput(SERIAL_SBUS);
+    for (uint8_t channel = 0; channel < 16; channel++)
+      values[channel] = 992 + i;
+    uint8_t size = sbusPacket(packet, values, 0);
+    hostMicros = starts[i];
+    feed(packet, size);
+    hostMicros += 700;
+    frame();
+    expect("servo following SBUS channel 15", servo.readMicroseconds(), (values[15] * 5UL >> 3) + 880);
+    expect("input latency", VarSpeedServo::inputLatency(), 700);
+    servo.detach();
+  }
+}
+
+int main()
+{
+  testSbus();
+  testIbus();
+  testLatency();
+  VarSpeedServo::beginSerialInput(0);
+  printf("test_serial: %d failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,51 @@
+/*
+  test_service.cpp - An engine run by service() must send the pulse widths written, at any F_CPU.
+
+  The pulses on the pin are timed with micros() advancing one microsecond per call, also across
+  the wrap around of micros(); the first pulse after a change is skipped. The pulse is shorter
+  than readMicroseconds() by the trim for the interrupt overhead. run.sh builds this test again at
+  clocks that aren't multiples of 8 MHz.
+*/
+
+#define TEST "test_service"
+#include "harness.h"
+
+int main()
+{
+  static const unsigned long starts[] = {0, 0xFFFFFFFFUL - 45000};
+  static const int widths[] = {1000, 1500, 2000};
+
+  snprintf(context, sizeof(context), " (F_CPU %lu)", (unsigned long)F_CPU);
+  VarSpeedServo servo(engine);
+  servo.attach(9);
+  for (uint8_t s = 0; s < 2; s++)
+    for (uint8_t w = 0; w < 3; w++) {
+      servo.writeMicroseconds(widths[w]);
+      int expected = servo.readMicroseconds() - 2;
+      if (w == 0)
+        hostMicros = starts[s];
+      unsigned long rise = 0;
+      uint8_t pulses = 0;
+      bool high = hostPortB & digitalPinToBitMask(9);
+      for (long step = 0; step < 200000 && pulses < 4; step++) {
+        engine.service();
+        bool pin = hostPortB & digitalPinToBitMask(9);
+        if (pin && !high) {
+          if (pulses > 1)
+            expectBetween("refresh interval", hostMicros - rise, REFRESH_INTERVAL - 2, REFRESH_INTERVAL + 2);
+          rise = hostMicros;
+        }
+        else if (!pin && high) {
+          if (pulses > 0)
+            expectBetween("pulse width", hostMicros - rise, expected - 1, expected + 1);
+          pulses++;
+        }
+        high = pin;
+        hostMicros++;
+      }
+      expect("pulses", pulses, 4);
+    }
+
+  printf("test_service: %d failures (F_CPU %lu)\n", failures, (unsigned long)F_CPU);
+  return failures != 0;
+}
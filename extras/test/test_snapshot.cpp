@@ -0,0 +1,57 @@
+/*
+  test_snapshot.cpp - snapshot() must copy what each servo is sending and heading for.
+
+  Three servos, one at rest, one in a slow move and one filtered, are copied every frame of a move:
+  positions must be what readMicroseconds() returns, targets the pulse widths written until they
+  are reached, and only the slow move may be moving. Count is limited to the servos of the engine.
+*/
+
+#define TEST "test_snapshot"
+#include "harness.h"
+
+int main()
+{
+  VarSpeedServo resting(engine), moving(engine), filtered(engine);
+  resting.attach(9);
+  moving.attach(10);
+  filtered.attach(11);
+  resting.writeMicroseconds(1100);
+  moving.writeMicroseconds(1000);
+  filtered.writeMicroseconds(1000);
+  frame();
+
+  servoSnapshot states[4];
+  expect("servos copied", engine.snapshot(states, 4), 3);
+  expect("servos copied of 2", engine.snapshot(states, 2), 2);
+  expect("servos copied of 0", engine.snapshot(states, 0), 0);
+
+  moving.write(2000, 30);
+  filtered.setFilter(FILTER_EMA(4));
+  filtered.writeMicroseconds(2000);
+  unsigned int frames = 0;
+  do {
+    snprintf(context, sizeof(context), ", frame %u", frames);
+    engine.snapshot(states, 3);
+    expect("position at rest", states[0].position, resting.readMicroseconds());
+    expect("target at rest", states[0].target, 1100);
+    expect("moving at rest", states[0].moving, 0);
+
+    bool done = !moving.isMoving();
+    expect("position of the slow move", states[1].position, moving.readMicroseconds());
+    expect("target of the slow move", states[1].target, 2000);
+    expect("moving of the slow move", states[1].moving, !done);
+
+    expect("position of the filtered servo", states[2].position, filtered.readMicroseconds());
+    expect("target of the filtered servo", states[2].target, 2000);
+    expect("moving of the filtered servo", states[2].moving, 0);
+    frame();
+  } while (++frames < 500 && (moving.isMoving() || filtered.readMicroseconds() != 2000));
+  context[0] = 0;
+  engine.snapshot(states, 3);
+  expect("moving at the end of the slow move", states[1].moving, 0);
+  expect("position at the end of the slow move", states[1].position, 2000);
+  expect("position at the end of the filter", states[2].position, 2000);
+
+  printf("test_snapshot: %u frames, %d failures\n", frames, failures);
+  return failures != 0;
+}
@@ -0,0 +1,95 @@
+/*
+  test_stop.cpp - stop() must hold a servo where it is, or brake it to a stop with acceleration.
+
+  Moves at random speeds are stopped after a random number of frames. Without acceleration the
+  pulse of every following frame must be the one sent last. With acceleration the servo must keep
+  its direction, never speed up, never pass the target it was heading for nor go beyond the limits,
+  and come to rest. A servo at rest must not move.
+*/
+
+#define TEST "test_stop"
+#include "harness.h"
+
+#define LOW_LIMIT 1000
+#define HIGH_LIMIT 2000
+
+static unsigned long stops;
+
+// a small linear congruential generator, so every run writes the same targets
+static uint32_t seed = 1;
+static unsigned int pick(unsigned int range)
+{
+  seed = seed * 1103515245UL + 12345;
+  return (seed >> 16) % range;
+}
+
+static void stopMove(VarSpeedServo &servo, unsigned int rate)
+{
+  servo.setAccelerationMicroseconds(0);
+  int start = LOW_LIMIT + pick(HIGH_LIMIT - LOW_LIMIT + 1);
+  servo.writeMicroseconds(start);
+  frame();
+  servo.setAccelerationMicroseconds(rate);
+  int target = LOW_LIMIT + pick(HIGH_LIMIT - LOW_LIMIT + 1);
+  uint8_t speed = 1 + pick(255);
+  unsigned int frames = 1 + pick(60);
+  snprintf(context, sizeof(context), ", from %d to %d uS at speed %d, %u uS/s^2, after %u frames",
+           start, target, speed, rate, frames);
+  servo.write(target, speed);
+  long last = frame();
+  long previous = usToPulse(start);
+  for (unsigned int i = 1; i < frames && servo.isMoving(); i++) {
+    previous = last;
+    last = frame();
+  }
+
+  servo.stop();
+  if (rate == 0) {
+    expect("servo moving after stop()", servo.isMoving(), 0);
+    for (uint8_t i = 0; i < 3; i++)
+      expect("pulse after stop()", frame(), last);
+    stops++;
+    return;
+  }
+  long to = usToPulse(target);
+  int direction = to > last ? 1 : to < last ? -1 : 0;
+  long step = labs(last - previous) + 1;           // the last step in whole ticks, rounded up
+  unsigned int n;
+  for (n = 0; n < 2000 && servo.isMoving(); n++) {
+    long pulse = frame();
+    long moved = pulse - last;
+    if ((direction > 0 && (moved < 0 || pulse > to)) || (direction < 0 && (moved > 0 || pulse < to)) ||
+        (direction == 0 && moved != 0)) {
+      expect("pulse while braking", pulse, last);
+      return;
+    }
+    if (labs(moved) > step) {
+      expectBetween("ticks moved per frame while braking", labs(moved), 0, step);
+      return;
+    }
+    expectBetween("pulse while braking", pulse, usToPulse(LOW_LIMIT), usToPulse(HIGH_LIMIT));
+    step = labs(moved) + 1;
+    last = pulse;
+  }
+  expect("servo moving long after stop()", servo.isMoving(), 0);
+  expect("pulse at rest after stop()", frame(), last);
+  stops++;
+}
+
+int main()
+{
+  VarSpeedServo servo(engine);
+  servo.attach(9, LOW_LIMIT, HIGH_LIMIT);
+  servo.writeMicroseconds(1234);
+  frame();
+  servo.stop();
+  expect("pulse of a servo stopped at rest", frame(), usToPulse(1234));
+
+  static const unsigned int rates[] = {0, 100, 1000, 5000, 20000, 65535};
+  for (uint8_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    for (unsigned int i = 0; i < 2000; i++)
+      stopMove(servo, rates[r]);
+
+  printf("test_stop: %lu stops, %d failures\n", stops, failures);
+  return failures != 0;
+}
@@ -0,0 +1,156 @@
+/*
+  test_timing.cpp - Pulse and frame timings of the timer interrupt, on a simulated timer.
+
+  ServoEngine runs from its compare interrupt while the count advances one tick at a time, called
+  exactly at each compare match; built with -DVARSPEEDSERVO_TIMER2 by run.sh it runs from the
+  Timer2 overflow and compare interrupts instead. The edges on the pins are timed in ticks and
+  must match the pulse widths written, the refresh interval and an edge delay of 0, also for the
+  ESCs a timer takes at full throttle, and escCalibrate() must not send DShot ESCs full throttle.
+
+  These are the figures the commits adding the backends quote, run.sh reproduces them.
+*/
+
+#define TEST "test_timing"
+#include "harness.h"
+
+#if defined(VARSPEEDSERVO_TIMER2)
+extern "C" void TIMER2_OVF_vect(void);
+extern "C" void TIMER2_COMPA_vect(void);
+#define BACKEND "Timer2"
+#define RESOLUTION 4                  // ticks per Timer2 count, compares are rounded to whole counts
+#else
+extern "C" void TIMER1_COMPA_vect(void);
+#define BACKEND "Timer1"
+#define RESOLUTION 1
+#endif
+
+static const unsigned long ticksPerUs = clockCyclesPerMicrosecond() / 8;
+
+// times the pulses of the servos on pins 8 to 15, in ticks of the simulated timer
+struct Edges {
+  uint8_t last;
+  unsigned long rise[8];
+  unsigned long width[8];
+  unsigned long frame[8];
+  uint8_t pulses[8];
+
+  void sample(unsigned long now) {
+    uint8_t port = hostPortB;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      uint8_t mask = 1 << bit;
+      if ((port & mask) && !(last & mask)) {
+        if (pulses[bit])
+          frame[bit] = now - rise[bit];
+        rise[bit] = now;
+      }
+      else if (!(port & mask) && (last & mask)) {
+        width[bit] = now - rise[bit];
+        pulses[bit]++;
+      }
+    }
+    last = port;
+  }
+};
+
+// runs ServoEngine for the given number of ticks
+static void run(Edges &edges, unsigned long ticks)
+{
+  static unsigned long now;
+  for (unsigned long end = now + ticks; now != end; now++) {
+#if defined(VARSPEEDSERVO_TIMER2)
+    if (now % RESOLUTION == 0) {
+      TIFR2 = 0;                      // the flags are cleared by writing them, the interrupts run at once here
+      TCNT2++;
+      if (TCNT2 == 0)
+        TIMER2_OVF_vect();
+      if (TCNT2 == OCR2A && (TIMSK2 & _BV(OCIE2A)))
+        TIMER2_COMPA_vect();
+    }
+#else
+    TCNT1++;
+    if (TCNT1 == OCR1A && (TIMSK1 & _BV(OCIE1A)))
+      TIMER1_COMPA_vect();
+#endif
+    hostMicros = now / ticksPerUs;
+    edges.sample(now);
+  }
+}
+
+static void testServoEngine()
+{
+  static const int widths[][2] = {{1500, 1001}, {544, 2400}, {1000, 2000}};
+  VarSpeedServo a, b;
+  a.attach(9);
+  b.attach(10);
+  Edges start = {};
+  run(start, 0x10000);                // the first compare match is a round of the counter away
+  for (uint8_t w = 0; w < 3; w++) {
+    Edges edges = {};
+    a.writeMicroseconds(widths[w][0]);
+    b.writeMicroseconds(widths[w][1]);
+    ServoEngine.edgeDelay();
+    run(edges, 3 * REFRESH_INTERVAL * ticksPerUs);
+    // the pulse is the width less the trim for the interrupt overhead, TRIM_DURATION in ticks
+    long first = (widths[w][0] - 2) * ticksPerUs;
+    long second = (widths[w][1] - 2) * ticksPerUs;
+    expectBetween("pulses of the first servo", edges.pulses[1], 2, 3);
+    expectBetween("pulses of the second servo", edges.pulses[2], 2, 3);
+    expectBetween("pulse of the first servo in ticks", edges.width[1], first - RESOLUTION / 2, first + RESOLUTION / 2);
+    expectBetween("pulse of the second servo in ticks", edges.width[2], second - RESOLUTION / 2, second + RESOLUTION / 2);
+    expectBetween("refresh interval in ticks", edges.frame[1], REFRESH_INTERVAL * ticksPerUs - RESOLUTION / 2,
+           REFRESH_INTERVAL * ticksPerUs + RESOLUTION / 2);
+    expect("edge delay", ServoEngine.edgeDelay(), 0);
+  }
+  a.detach();
+  b.detach();
+}
+
+// as many ESCs as a timer takes at full throttle must keep the refresh interval of their protocol
+static void testEsc()
+{
+  static const struct {
+    escProtocol_t protocol;
+    uint8_t channels;
+    unsigned int max;
+    unsigned int refresh;
+  } escs[] = {{ESC_PWM, 1, 2000, 2500}, {ESC_ONESHOT125, 1, 250, 500}, {ESC_ONESHOT42, 2, 84, 250}};
+
+  for (uint8_t e = 0; e < 3; e++) {
+    VarSpeedServo esc[3];
+    for (uint8_t i = 0; i < escs[e].channels; i++) {
+      expect("ESC attached", esc[i].attachEsc(8 + i, escs[e].protocol) != INVALID_SERVO, 1);
+      esc[i].writeMicroseconds(escs[e].max);
+    }
+    expect("ESC attached past the channels of its protocol",
+           esc[escs[e].channels].attachEsc(8 + escs[e].channels, escs[e].protocol) != INVALID_SERVO, 0);
+    Edges start = {};
+    run(start, 0x10000);              // the timer was stopped when the last channel was detached
+    Edges edges = {};
+    run(edges, 5 * escs[e].refresh * ticksPerUs);
+    for (uint8_t i = 0; i < escs[e].channels; i++) {
+      long pulse = (escs[e].max - 2) * ticksPerUs;
+      expectBetween("ESC pulse in ticks", edges.width[i], pulse - RESOLUTION / 2, pulse + RESOLUTION / 2);
+      expectBetween("ESC refresh interval in ticks", edges.frame[i], escs[e].refresh * ticksPerUs - RESOLUTION / 2,
+                    escs[e].refresh * ticksPerUs + RESOLUTION / 2);
+    }
+    for (uint8_t i = 0; i < 3; i++)
+      esc[i].detach();
+  }
+
+  // DShot needs no calibration, full throttle would spin the motor
+  VarSpeedServo dshot;
+  dshot.attachEsc(8, ESC_DSHOT150);
+  unsigned long start = hostMicros;
+  dshot.escCalibrate(100);
+  expect("uS spent by escCalibrate() on DShot", hostMicros - start, 0);
+  dshot.detach();
+}
+
+int main()
+{
+  snprintf(context, sizeof(context), " (%s)", BACKEND);
+  testServoEngine();
+  testEsc();
+  printf("test_timing: %d failures (%s)\n", failures, BACKEND);
+  return failures != 0;
+}